@@ -23,13 +23,16 @@ void setup() {
   }
   
   Serial.print("Initializing Wire bus...");
-  uint8_t err = iic.begin();
+  uint8_t err = iic.begin(/*freq=*/IIC_CLOCK_AUTO);
   if(err != 0){
     Serial.print("failed! error code is 0x");
     Serial.println(err, HEX);
     while(1) yield();
   }
   Serial.println("done.");
+  Serial.print("I2C clock: ");
+  Serial.print(iic.getClock());
+  Serial.println(" Hz");
 
   Serial.print("Initializing Flash Memory Module...");
   err = module.init(&iic);
@@ -0,0 +1,103 @@
+/*!
+ * @file 07.binaryRecord.ino
+ * @brief 定长二进制记录的读写。
+ * @n 通过特化DFRobot_Codec，结构体按固定的小端格式写入，与编译器的对齐方式和CPU字节序无关，
+ * @n 在AVR上写入的文件可以直接在ESP32上读出。每条记录只需一次写文件命令。
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+
+typedef struct{
+  uint32_t time;
+  int16_t  temperature;
+  float    humidity;
+}sSample_t;
+
+//sSample_t在文件中的格式：time(4) + temperature(2) + humidity(4)，共10字节
+template<> struct DFRobot_Codec<sSample_t>{
+  enum{ size = DFRobot_Codec<uint32_t>::size + DFRobot_Codec<int16_t>::size + DFRobot_Codec<float>::size };
+  static uint8_t *encode(uint8_t *p, const sSample_t &v){
+    p = DFRobot_Encode(p, v.time);
+    p = DFRobot_Encode(p, v.temperature);
+    return DFRobot_Encode(p, v.humidity);
+  }
+  static const uint8_t *decode(const uint8_t *p, sSample_t &v){
+    p = DFRobot_Decode(p, v.time);
+    p = DFRobot_Decode(p, v.temperature);
+    return DFRobot_Decode(p, v.humidity);
+  }
+};
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+
+void setup() {
+  // Open serial communications and wait for port to open:
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  flash.remove("samples.bin");
+  myFile = flash.open("samples.bin", FILE_WRITE);
+  if (!myFile) {
+    Serial.println("error opening samples.bin");
+    while(1) yield();
+  }
+  Serial.print("Writing samples...");
+  for(uint8_t i = 0; i < 10; i++){
+    sSample_t s;
+    s.time = millis();
+    s.temperature = 250 + i;
+    s.humidity = 40.5 + i;
+    myFile.write<sSample_t>(s);
+  }
+  myFile.close();
+  Serial.println("done.");
+
+  myFile = flash.open("samples.bin");
+  //按编号直接读第5条记录
+  sSample_t s;
+  if(myFile.pread(5 * DFRobot_Codec<sSample_t>::size, s)){
+    Serial.print("sample 5: temperature = ");
+    Serial.println(s.temperature);
+  }
+  //顺序读出所有记录
+  while(myFile.read(s)){
+    Serial.print(s.time);
+    Serial.print(", ");
+    Serial.print(s.temperature);
+    Serial.print(", ");
+    Serial.println(s.humidity);
+  }
+  myFile.close();
+}
+
+void loop() {
+  // nothing happens after setup
+}
@@ -0,0 +1,96 @@
+/*!
+ * @file 08.copyFile.ino
+ * @brief 整块复制文件，并与逐字节读取的方式比较速度。
+ * @n 先生成一个4KB的测试文件，分别用逐字节read()和copyTo()把它输出到串口，打印两种方式的有效速度(KB/s)，
+ * @n 最后用copy()在模块内复制一份文件。
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+
+#define TEST_SIZE  4096
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+
+void printSpeed(const char *name, uint32_t bytes, uint32_t ms){
+  Serial.print(name);
+  Serial.print(bytes);
+  Serial.print(" bytes in ");
+  Serial.print(ms);
+  Serial.print(" ms, ");
+  Serial.print(ms ? (float)bytes * 1000 / 1024 / ms : 0);
+  Serial.println(" KB/s");
+}
+
+void setup() {
+  // Open serial communications and wait for port to open:
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin(/*freq=*/IIC_CLOCK_AUTO);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  flash.remove("bench.txt");
+  myFile = flash.open("bench.txt", FILE_WRITE);
+  for(uint16_t i = 0; i < TEST_SIZE / 64; i++){
+    myFile.println("0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  }
+  myFile.close();
+
+  //逐字节读取，每个字节一次读文件命令
+  myFile = flash.open("bench.txt");
+  uint32_t t = millis();
+  uint32_t n = 0;
+  while (myFile.available()) {
+    Serial.write(myFile.read());
+    n++;
+  }
+  uint32_t byteLoop = millis() - t;
+  myFile.close();
+
+  //整块复制，读下一块的同时串口在后台发送
+  myFile = flash.open("bench.txt");
+  t = millis();
+  uint32_t m = myFile.copyTo(Serial);
+  uint32_t copyTo = millis() - t;
+  myFile.close();
+
+  Serial.println();
+  printSpeed("read() loop: ", n, byteLoop);
+  printSpeed("copyTo():    ", m, copyTo);
+
+  t = millis();
+  if(flash.copy("bench.txt", "bench2.txt")){
+    printSpeed("copy():      ", TEST_SIZE, millis() - t);
+  }else{
+    Serial.println("copy failed.");
+  }
+}
+
+void loop() {
+  // nothing happens after setup
+}
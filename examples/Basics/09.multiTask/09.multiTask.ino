@@ -0,0 +1,91 @@
+/*!
+ * @file 09.multiTask.ino
+ * @brief 多个FreeRTOS任务同时写各自的日志文件(仅ESP32)。
+ * @n startDispatcher启动调度任务后，各任务的命令排队由调度任务依次执行，不会互相打断；
+ * @n 一个任务整块写入期间，其他任务排队的小记录会合并成一条命令发送。
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+
+#if !FLASH_THREAD_SAFE
+#error "This example needs FreeRTOS (ESP32)."
+#endif
+
+#define TASK_NUM  3
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File logs[TASK_NUM];
+
+void logTask(void *arg){
+  uint8_t n = (uint32_t)arg;
+  for(uint16_t i = 0; i < 100; i++){
+    logs[n].print("task ");
+    logs[n].print(n);
+    logs[n].print(", record ");
+    logs[n].println(i);
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+  logs[n].close();
+  Serial.print("task ");
+  Serial.print(n);
+  Serial.println(" done.");
+  vTaskDelete(NULL);
+}
+
+void setup() {
+  // Open serial communications and wait for port to open:
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin(/*freq=*/IIC_CLOCK_AUTO);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  if(!flash.startDispatcher()){
+    Serial.println("start dispatcher failed!");
+    while(1) yield();
+  }
+
+  //文件在同一个任务中打开，再交给各任务读写
+  for(uint8_t i = 0; i < TASK_NUM; i++){
+    char name[12];
+    sprintf(name, "task%d.txt", i);
+    flash.remove(name);
+    logs[i] = flash.open(name, FILE_WRITE);
+    if(!logs[i]){
+      Serial.print("error opening ");
+      Serial.println(name);
+      while(1) yield();
+    }
+  }
+  for(uint8_t i = 0; i < TASK_NUM; i++){
+    xTaskCreate(logTask, "log", 4096, (void *)(uint32_t)i, 1, NULL);
+  }
+}
+
+void loop() {
+  // nothing happens after setup
+}
@@ -0,0 +1,281 @@
+/*!
+ * @file 10.serialShell.ino
+ * @brief 串口命令行，用于批量下载配置文件和导出日志。
+ * @n 串口发送一行命令，以换行结束，每条命令执行后打印字节数、用时和速度(KB/s)，用来估算产线烧录站的吞吐量：
+ * @n   ls [dir]          递归列出目录，每个目录只需一次带属性的批量读目录命令
+ * @n   du [dir]          统计目录下的文件个数和总大小
+ * @n   cat <file>        整块读取文件输出到串口，读下一块的同时串口在后台发送
+ * @n   put <file> <len>  删除并重建文件，接着从串口接收len字节写入，2秒没有收到数据时结束
+ * @n   sync <file> <len> 与put相同，但只把内容变化的块写入模块，适合重新下载大部分内容不变的文件
+ * @n   cp <from> <to>    在模块内复制文件
+ * @n   mv <from> <to>    重命名或移动文件、目录，只修改目录项，模块支持重命名命令时已存在的目标文件被替换
+ * @n   rm <path>         删除文件或整个目录
+ * @n   df                显示容量和空闲空间
+ * @n   tar [dir]         把目录打包成tar格式输出，电脑上保存后可以直接用tar解包
+ * @n   untar [dir]       从串口接收tar包，还原到dir下，2秒没有收到数据时结束
+ * @n 统计信息以"# "开头单独一行，上位机导出文件时可以据此与文件内容分开；tar输出的数据以"# ready"的下一行开始，
+ * @n 到tar包结束为止，长度是512的整数倍
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+
+typedef struct{
+  uint32_t files;
+  uint32_t dirs;
+  uint32_t bytes;
+  bool print;
+}sTotal_t;
+
+void printSpeed(const char *name, uint32_t bytes, uint32_t ms){
+  Serial.print("# ");
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(bytes);
+  Serial.print(" bytes in ");
+  Serial.print(ms);
+  Serial.print(" ms, ");
+  Serial.print(ms ? (float)bytes * 1000 / 1024 / ms : 0);
+  Serial.println(" KB/s");
+}
+
+bool onEntry(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg){
+  sTotal_t *total = (sTotal_t *)arg;
+  if(attr == 5){
+    total->dirs++;
+  }else{
+    total->files++;
+    total->bytes += size;
+  }
+  if(total->print){
+    for(uint8_t i = 1; i < depth; i++) Serial.print("  ");
+    Serial.print(path);
+    if(attr == 5){
+      Serial.println("/");
+    }else{
+      Serial.print("\t");
+      Serial.println(size);
+    }
+  }
+  return true;
+}
+
+void listDir(const char *dir, bool print){
+  sTotal_t total = {0, 0, 0, print};
+  uint32_t t = millis();
+  if(!flash.walk(dir, onEntry, &total)){
+    Serial.println("# walk failed.");
+    return;
+  }
+  t = millis() - t;
+  Serial.print("# ");
+  Serial.print(total.files);
+  Serial.print(" files, ");
+  Serial.print(total.dirs);
+  Serial.print(" dirs, ");
+  Serial.print(total.bytes);
+  Serial.print(" bytes, listed in ");
+  Serial.print(t);
+  Serial.println(" ms");
+}
+
+void catFile(const char *path){
+  DFRobot_File f = flash.open(path);
+  if(!f){
+    Serial.println("# open failed.");
+    return;
+  }
+  uint32_t t = millis();
+  uint32_t n = f.copyTo(Serial);
+  t = millis() - t;
+  f.close();
+  Serial.println();
+  printSpeed("cat", n, t);
+}
+
+void putFile(const char *path, uint32_t len){
+  flash.remove(path);
+  DFRobot_File f = flash.open(path, FILE_WRITE);
+  if(!f){
+    Serial.println("# open failed.");
+    return;
+  }
+  //预分配连续空间，模块不支持时忽略
+  f.reserve(len);
+  Serial.println("# ready");
+  uint32_t t = millis();
+  Serial.setTimeout(2000);
+  uint32_t n = f.copyFrom(Serial, len);
+  f.close();
+  t = millis() - t;
+  printSpeed("put", n, t);
+  if(n != len) Serial.println("# incomplete.");
+}
+
+//统计实际输出的字节数，同时转发给串口
+class CountPrint : public Print{
+public:
+  CountPrint(Print &out):count(0), _out(out){}
+  virtual size_t write(uint8_t c){ return write(&c, 1); }
+  virtual size_t write(const uint8_t *buf, size_t size){
+    size_t n = _out.write(buf, size);
+    count += n;
+    return n;
+  }
+  virtual int availableForWrite(){ return _out.availableForWrite(); }
+  uint32_t count;
+private:
+  Print &_out;
+};
+
+void exportDir(const char *dir){
+  CountPrint out(Serial);
+  Serial.println("# ready");
+  uint32_t t = millis();
+  bool ok = flash.exportTree(dir, out);
+  t = millis() - t;
+  Serial.println();
+  printSpeed("tar", out.count, t);
+  if(!ok) Serial.println("# tar failed.");
+}
+
+void importDir(const char *dir){
+  Serial.println("# ready");
+  uint32_t t = millis();
+  Serial.setTimeout(2000);
+  bool ok = flash.importTree(dir, Serial);
+  t = millis() - t;
+  Serial.print("# untar ");
+  Serial.print(ok ? "done" : "failed");
+  Serial.print(" in ");
+  Serial.print(t);
+  Serial.println(" ms");
+}
+
+void syncFile(const char *path, uint32_t len){
+  DFRobot_File f = flash.open(path, FILE_WRITE);
+  if(!f){
+    Serial.println("# open failed.");
+    return;
+  }
+  Serial.println("# ready");
+  uint32_t t = millis();
+  Serial.setTimeout(2000);
+  uint32_t written = 0;
+  bool ok = f.syncFrom(Serial, len, &written);
+  //截断原来比len长的部分
+  ok = f.close(true) && ok;
+  t = millis() - t;
+  printSpeed("sync", len, t);
+  Serial.print("# ");
+  Serial.print(written);
+  Serial.print(" bytes written, ");
+  Serial.print(len - written);
+  Serial.println(" bytes unchanged");
+  if(!ok) Serial.println("# incomplete.");
+}
+
+void execute(char *line){
+  char *cmd = strtok(line, " \t\r");
+  char *arg1 = strtok(NULL, " \t\r");
+  char *arg2 = strtok(NULL, " \t\r");
+  if(cmd == NULL) return;
+  uint32_t t = millis();
+  if(strcmp(cmd, "ls") == 0){
+    listDir(arg1 ? arg1 : "/", true);
+  }else if(strcmp(cmd, "du") == 0){
+    listDir(arg1 ? arg1 : "/", false);
+  }else if((strcmp(cmd, "cat") == 0) && arg1){
+    catFile(arg1);
+  }else if((strcmp(cmd, "put") == 0) && arg1 && arg2){
+    putFile(arg1, strtoul(arg2, NULL, 10));
+  }else if((strcmp(cmd, "sync") == 0) && arg1 && arg2){
+    syncFile(arg1, strtoul(arg2, NULL, 10));
+  }else if((strcmp(cmd, "cp") == 0) && arg1 && arg2){
+    DFRobot_File f = flash.open(arg1);
+    uint32_t size = f.size();
+    f.close();
+    if(flash.copy(arg1, arg2)) printSpeed("cp", size, millis() - t);
+    else Serial.println("# copy failed.");
+  }else if((strcmp(cmd, "mv") == 0) && arg1 && arg2){
+    if(flash.rename(arg1, arg2)){
+      Serial.print("# moved in ");
+      Serial.print(millis() - t);
+      Serial.println(" ms");
+    }else{
+      Serial.println("# move failed.");
+    }
+  }else if((strcmp(cmd, "rm") == 0) && arg1){
+    if(flash.removeTree(arg1)){
+      Serial.print("# removed in ");
+      Serial.print(millis() - t);
+      Serial.println(" ms");
+    }else{
+      Serial.println("# remove failed.");
+    }
+  }else if(strcmp(cmd, "tar") == 0){
+    exportDir(arg1 ? arg1 : "/");
+  }else if(strcmp(cmd, "untar") == 0){
+    importDir(arg1 ? arg1 : "/");
+  }else if(strcmp(cmd, "df") == 0){
+    flash.refreshSpace();
+    Serial.print("# capacity ");
+    Serial.print(flash.capacity());
+    Serial.print(" bytes, free ");
+    Serial.print(flash.freeSpace());
+    Serial.println(" bytes");
+  }else{
+    Serial.println("# commands: ls [dir], du [dir], cat <file>, put <file> <len>, sync <file> <len>, cp <from> <to>, mv <from> <to>, rm <path>, df, tar [dir], untar [dir]");
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin(/*freq=*/IIC_CLOCK_AUTO);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+  Serial.print("> ");
+}
+
+void loop() {
+  static char line[96];
+  static uint8_t len = 0;
+  while(Serial.available()){
+    char c = Serial.read();
+    if(c == '\n'){
+      line[len] = '\0';
+      Serial.println(line);
+      execute(line);
+      len = 0;
+      Serial.print("> ");
+    }else if(len < sizeof(line) - 1){
+      line[len++] = c;
+    }
+  }
+}
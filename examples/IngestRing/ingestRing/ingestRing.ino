@@ -0,0 +1,93 @@
+/*!
+ * @file ingestRing.ino
+ * @brief 在中断中采样，loop中批量写入文件。
+ * @n 中断服务函数只把采样放入环形缓存，不会被flash写入阻塞；loop攒够512字节后用一次写文件命令写入，
+ * @n 并打印丢弃的采样条数和缓存的最大占用，用来调整缓存大小
+ * @n 采样中断由引脚2上的外部信号触发，例如把PWM输出接到引脚2
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+#include "DFRobot_IngestRing.h"
+
+#define SAMPLE_PIN  2
+
+typedef struct{
+  uint32_t us;
+  int16_t  value;
+}sSample_t;
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+DFRobot_IngestRing ring;
+uint8_t ringBuf[1024];
+
+volatile int16_t lastValue = 0;
+
+void FLASH_ISR_ATTR onSample(){
+  sSample_t s;
+  s.us = micros();
+  s.value = lastValue;
+  ring.push(&s, sizeof(s));
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  myFile = flash.open("samples.bin", FILE_APPEND);
+  if(!myFile){
+    Serial.println("open samples.bin failed.");
+    while(1) yield();
+  }
+  ring.begin(ringBuf, sizeof(ringBuf));
+  pinMode(SAMPLE_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(SAMPLE_PIN), onSample, RISING);
+}
+
+void loop() {
+  static uint32_t lastReport = 0;
+  //analogRead不能在中断中调用，在loop中更新，中断只记录时间和最近一次的值
+  int16_t value = analogRead(A0);
+  noInterrupts();
+  lastValue = value;
+  interrupts();
+  ring.drain(myFile, 512);
+
+  if(millis() - lastReport >= 5000){
+    lastReport = millis();
+    myFile.flush();
+    Serial.print("size: ");
+    Serial.print(myFile.size());
+    Serial.print(", overruns: ");
+    Serial.print(ring.overruns());
+    Serial.print(", high water: ");
+    Serial.println(ring.highWater());
+  }
+}
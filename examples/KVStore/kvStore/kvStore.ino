@@ -0,0 +1,68 @@
+/*!
+ * @file kvStore.ino
+ * @brief 键值存储，保存配置和状态值。
+ * @n 所有键值保存在一个段文件中，更新只追加一条记录，loop中调用poll在后台回收被覆盖的旧记录
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+#include "DFRobot_KVStore.h"
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_KVStore kv;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  int ret = kv.begin(&flash, "CONFIG");
+  if(ret != 0){
+    Serial.print("kv store init failed, code: ");
+    Serial.println(ret);
+    while(1) yield();
+  }
+
+  uint32_t boots = 0;
+  kv.get("boots", &boots, sizeof(boots));
+  boots++;
+  kv.put("boots", &boots, sizeof(boots));
+  kv.put("name", "sensor-01", 9);
+  kv.sync();
+  Serial.print("boot count: ");
+  Serial.println(boots);
+}
+
+void loop() {
+  uint32_t t = millis();
+  kv.put("uptime", &t, sizeof(t));
+  kv.sync();
+  //被覆盖的记录超过阈值时在后台压缩
+  kv.poll();
+  delay(1000);
+}
@@ -0,0 +1,73 @@
+/*!
+ * @file ringLog.ino
+ * @brief 循环日志，只保留最近写入的数据。
+ * @n 日志文件大小固定，写满后新记录覆盖最旧的记录，不需要删除或重建文件
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+#include "DFRobot_RingLog.h"
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+DFRobot_RingLog ringLog;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  myFile = flash.open("ring.log", FILE_WRITE);
+  //数据区4KB，第一次运行时格式化，之后继续使用已有的记录
+  int ret = ringLog.begin(&myFile, 4096);
+  if(ret != 0){
+    Serial.print("ring log init failed, code: ");
+    Serial.println(ret);
+    while(1) yield();
+  }
+  Serial.print("records: ");
+  Serial.println(ringLog.count());
+}
+
+void loop() {
+  static uint32_t appended = 0;
+  char line[32];
+  int n = snprintf(line, sizeof(line), "%lu ms, A0=%d", millis(), analogRead(A0));
+  ringLog.append(line, n);
+
+  if(++appended % 50 == 0){
+    //从旧到新打印所有记录
+    ringLog.rewind();
+    int32_t len;
+    while((len = ringLog.readNext(line, sizeof(line) - 1)) >= 0){
+      line[len < (int32_t)sizeof(line) - 1 ? len : sizeof(line) - 1] = '\0';
+      Serial.println(line);
+    }
+  }
+  delay(1000);
+}
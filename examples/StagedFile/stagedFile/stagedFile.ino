@@ -0,0 +1,85 @@
+/*!
+ * @file stagedFile.ino
+ * @brief 后台写文件(仅ESP32)。
+ * @n loop中的print只把数据复制到暂存缓存，由核0上的工作任务合并成大块写入并每秒同步一次；
+ * @n 每写100行调用一次flush，等待这些数据同步到flash，并打印写一行和flush各用的时间
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+#include "DFRobot_StagedFile.h"
+
+#if !FLASH_THREAD_SAFE
+#error "This example needs FreeRTOS (ESP32)."
+#endif
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+DFRobot_StagedFile staged;
+uint8_t stageBuf[4096];
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  myFile = flash.open("staged.log", FILE_APPEND);
+  //之后myFile只由工作任务使用，应用通过staged写入
+  if(!staged.begin(&myFile, stageBuf, sizeof(stageBuf), /*syncMs=*/1000)){
+    Serial.println("start worker failed.");
+    while(1) yield();
+  }
+}
+
+void loop() {
+  static uint32_t line = 0;
+  uint32_t t = micros();
+  staged.print(millis());
+  staged.print(" ms, A0=");
+  staged.println(analogRead(A0));
+  t = micros() - t;
+
+  if(++line % 100 == 0){
+    uint32_t f = micros();
+    bool ok = staged.sync();
+    f = micros() - f;
+    Serial.print("line ");
+    Serial.print(line);
+    Serial.print(": print ");
+    Serial.print(t);
+    Serial.print(" us, flush ");
+    Serial.print(f);
+    Serial.print(" us, size ");
+    Serial.println(staged.size());
+    if(!ok){
+      Serial.println("write failed.");
+      while(1) yield();
+    }
+  }
+  delay(10);
+}
@@ -0,0 +1,78 @@
+/*!
+ * @file timeLog.ino
+ * @brief 时间日志，按时间范围查询传感器数据。
+ * @n 每秒记录一次A0的读数，串口输入两个以空格分隔的时间(单位秒)，打印这段时间内的记录
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version V1.0
+ * @date 2021-11-04
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_Flash_Moudle.h"
+#include "DFRobot_TimeLog.h"
+
+DFRobot_FlashMoudle_IIC iic(/*addr=*/0x55);
+DFRobot_FlashMoudle flash;
+DFRobot_File myFile;
+DFRobot_TimeLog timeLog;
+uint32_t base = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  
+  Serial.print("Initializing Wire bus...");
+  uint8_t err = iic.begin();
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  Serial.print("Initializing Flash Memory Module...");
+  err = flash.begin(&iic);
+  if(err != 0){
+    Serial.print("failed! error code is 0x");
+    Serial.println(err, HEX);
+    while(1) yield();
+  }
+  Serial.println("done.");
+
+  myFile = flash.open("sensor.tlg", FILE_WRITE);
+  //每条记录保存一个uint16_t
+  int ret = timeLog.begin(&myFile, sizeof(uint16_t));
+  if(ret != 0){
+    Serial.print("time log init failed, code: ");
+    Serial.println(ret);
+    while(1) yield();
+  }
+  //重新上电后时间戳接着上次的最后一条记录
+  base = timeLog.lastTime();
+  Serial.print("records: ");
+  Serial.println(timeLog.count());
+}
+
+void loop() {
+  uint32_t now = base + millis() / 1000;
+  uint16_t value = analogRead(A0);
+  timeLog.append(now, &value);
+
+  if(Serial.available()){
+    uint32_t t1 = Serial.parseInt();
+    uint32_t t2 = Serial.parseInt();
+    if(timeLog.seekTime(t1)){
+      uint32_t t;
+      while(timeLog.readNext(&t, &value) && (t <= t2)){
+        Serial.print(t);
+        Serial.print(": ");
+        Serial.println(value);
+      }
+    }
+  }
+  delay(1000);
+}
@@ -21,10 +21,35 @@
 #define IIC_MAX_TRANSFER   32 //< AVR/8266
 #endif
 
+#if defined(ESP32) || defined(ESP8266)
+#define DRV_ISR_ATTR       IRAM_ATTR
+#else
+#define DRV_ISR_ATTR
+#endif
+
+DFRobot_FlashMoudle_IIC *DFRobot_FlashMoudle_IIC::_readyDrv[FLASH_READY_PIN_NUM];
+
+//每个就绪引脚槽位一个中断服务函数，中断只通知占用该槽位的对象
+template<uint8_t N>
+void DRV_ISR_ATTR DFRobot_FlashMoudle_IIC::readyISR(){
+    if(_readyDrv[N]) _readyDrv[N]->notifyReady();
+}
+
+void (* const DFRobot_FlashMoudle_IIC::_readyISR[FLASH_READY_PIN_NUM])() = {readyISR<0>, readyISR<1>};
+
+#define IIC_PROBE_CMD      0x03  ///< 校验通信用的命令，即CMD_READ_ADDR，响应为IIC地址
+#define IIC_PROBE_TIMEOUT  100   ///< 校验通信时等待响应的时间，单位ms
+
+static const uint32_t IIC_CLOCK_RATES[] = {100000, 400000, 1000000};
+#define IIC_CLOCK_RATE_NUM (sizeof(IIC_CLOCK_RATES) / sizeof(IIC_CLOCK_RATES[0]))
+
 DFRobot_FlashMoudle_IIC::DFRobot_FlashMoudle_IIC(uint8_t addr,TwoWire *pWire)
-  :_pWire(pWire), _addr(addr){}
+  :_pWire(pWire), _addr(addr), _readyPin(-1), _clock(0), _autoClock(false),
+   _clockPending(false), _busOpen(false), _rateIdx(0), _errCount(0), _okCount(0), _errTotal(0){}
 
 DFRobot_FlashMoudle_IIC::~DFRobot_FlashMoudle_IIC(){
+    //释放就绪引脚的中断和槽位，之后的上升沿不能再通知已销毁的对象
+    setReadyPin(-1);
     DBG((uint32_t)(uint32_t *)_pWire, HEX);
     _pWire = NULL;
 }
@@ -35,17 +60,89 @@ uint8_t DFRobot_FlashMoudle_IIC::begin(uint32_t freq){
         return 1;
     }
     delay(500);
+    _autoClock = false;
+    _clockPending = false;
+    _busOpen = false;
+    _errCount = _okCount = 0;
+    _errTotal = 0;
+    _clock = (freq == IIC_CLOCK_AUTO) ? IIC_CLOCK_RATES[0] : freq;
     _pWire->begin();
-    _pWire->setClock(freq);
+    _pWire->setClock(_clock);
     _pWire->beginTransmission(_addr);
     byte ret = _pWire->endTransmission();
     if(ret != 0){
         DRV_DBG("device not found.");
         return 2;
     }
+    if(freq != IIC_CLOCK_AUTO) return 0;
+    //从低到高依次尝试，某个频率校验失败就停在上一个频率
+    _rateIdx = 0;
+    for(uint8_t i = 1; i < IIC_CLOCK_RATE_NUM; i++){
+        _pWire->setClock(IIC_CLOCK_RATES[i]);
+        if(!probe(IIC_PROBE_TIMES)) break;
+        _rateIdx = i;
+    }
+    //通过的最高频率再连续校验更多次留出余量，不通过就退回下一档
+    if(_rateIdx){
+        _pWire->setClock(IIC_CLOCK_RATES[_rateIdx]);
+        if(!probe(IIC_PROBE_CONFIRM)) _rateIdx--;
+    }
+    _clock = IIC_CLOCK_RATES[_rateIdx];
+    _pWire->setClock(_clock);
+    _errCount = _okCount = 0;
+    _errTotal = 0;
+    _autoClock = true;
+    DRV_DBG(_clock);
     return 0;
 }
 
+bool DFRobot_FlashMoudle_IIC::probe(uint16_t times){
+    for(uint16_t i = 0; i < times; i++){
+        uint8_t pkt[3] = {IIC_PROBE_CMD, 0, 0};
+        uint8_t state = 0;
+        if(!sendData(pkt, sizeof(pkt), true)) return false;
+        uint32_t t = millis();
+        while(millis() - t < IIC_PROBE_TIMEOUT){
+            if(!recvData(&state, 1, true)) return false;
+            if(state == 0x53) break;
+            delay(1);
+        }
+        if(state != 0x53) return false;
+        //cmd + 长度(2) + IIC地址，任何一个字节不对都说明这个频率下通信不可靠
+        uint8_t resp[4];
+        if(!recvData(resp, sizeof(resp), true)) return false;
+        if((resp[0] != IIC_PROBE_CMD) || (resp[1] != 1) || (resp[2] != 0) || (resp[3] != _addr)) return false;
+    }
+    return true;
+}
+
+void DFRobot_FlashMoudle_IIC::checkError(bool ok){
+    if(ok){
+        if(_errCount && (++_okCount >= IIC_ERR_DECAY)){
+            _errCount--;
+            _okCount = 0;
+        }
+        return;
+    }
+    _errTotal++;
+    _okCount = 0;
+    //已经在等待降频时，这次传输里后面的错误还是旧频率下的，不再累计
+    if(_clockPending) return;
+    if((++_errCount < IIC_ERR_THRESHOLD) || !_autoClock || (_rateIdx == 0)) return;
+    //出错时可能还在一次传输中间(未发送停止位)，先记下，等总线空闲时再降频
+    _rateIdx--;
+    _clockPending = true;
+    _errCount = 0;
+}
+
+void DFRobot_FlashMoudle_IIC::applyClock(){
+    if(!_clockPending || _busOpen) return;
+    _clockPending = false;
+    _clock = IIC_CLOCK_RATES[_rateIdx];
+    _pWire->setClock(_clock);
+    DRV_DBG(_clock);
+}
+
 bool DFRobot_FlashMoudle_IIC::sendData(void* pData, uint16_t size, bool endflag){
     if(pData == NULL){
         DRV_DBG("pData is NULL");
@@ -57,6 +154,7 @@ bool DFRobot_FlashMoudle_IIC::sendData(void* pData, uint16_t size, bool endflag)
     DRV_DBG();
     flush();
     DRV_DBG();
+    applyClock();
     while(remain){
         size = (remain > IIC_MAX_TRANSFER) ? IIC_MAX_TRANSFER : remain;
         remain -= size;
@@ -68,9 +166,15 @@ bool DFRobot_FlashMoudle_IIC::sendData(void* pData, uint16_t size, bool endflag)
         }else{
             ret = _pWire->endTransmission(endflag);
         }
-        if(ret != 0) return false;
+        checkError(ret == 0);
+        if(ret != 0){
+            _busOpen = false;
+            return false;
+        }
         yield();
     }
+    _busOpen = !endflag;
+    applyClock();
     return true;
 }
 bool DFRobot_FlashMoudle_IIC::recvData(void* pData, uint16_t size, bool endflag){
@@ -80,16 +184,19 @@ bool DFRobot_FlashMoudle_IIC::recvData(void* pData, uint16_t size, bool endflag)
     }
     uint8_t *pBuf = (uint8_t *)pData;
     uint16_t remain =  size ;
+    applyClock();
     while(remain){
         size = (remain > IIC_MAX_TRANSFER) ? IIC_MAX_TRANSFER : remain;
         remain -= size;
+        uint8_t got = 0;
 #ifdef __AVR__
-        if(remain) _pWire->requestFrom((uint8_t)_addr, (uint8_t)size, (uint8_t)false);
-        else _pWire->requestFrom((uint8_t)_addr, (uint8_t)size, (uint8_t)endflag);
+        if(remain) got = _pWire->requestFrom((uint8_t)_addr, (uint8_t)size, (uint8_t)false);
+        else got = _pWire->requestFrom((uint8_t)_addr, (uint8_t)size, (uint8_t)endflag);
 #else
-        if(remain) _pWire->requestFrom(_addr, size, false);
-        else _pWire->requestFrom(_addr, size, endflag);
+        if(remain) got = _pWire->requestFrom(_addr, size, false);
+        else got = _pWire->requestFrom(_addr, size, endflag);
 #endif
+        checkError(got == size);
         for(size_t i = 0; i < size; i++){
             pBuf[i] = _pWire->read();
             DRV_DBG(pBuf[i],HEX);
@@ -97,6 +204,8 @@ bool DFRobot_FlashMoudle_IIC::recvData(void* pData, uint16_t size, bool endflag)
         }
         if(remain) pBuf += size;
     }
+    _busOpen = !endflag;
+    applyClock();
     return true;
 }
 
@@ -106,4 +215,36 @@ void DFRobot_FlashMoudle_IIC::flush(){
         delay(1);
         yield();
     }
-}
\ No newline at end of file
+}
+
+bool DFRobot_FlashMoudle_IIC::setReadyPin(int pin){
+    if(_readyPin >= 0){
+        detachInterrupt(digitalPinToInterrupt(_readyPin));
+        for(uint8_t i = 0; i < FLASH_READY_PIN_NUM; i++){
+            if(_readyDrv[i] == this) _readyDrv[i] = NULL;
+        }
+        _readyPin = -1;
+    }
+    setReadyMode(false);
+    if(pin < 0) return true;
+    //引脚已被其他对象使用或槽位用完时拒绝，保持轮询模式，不抢占其他对象的通知
+    int8_t slot = -1;
+    for(uint8_t i = 0; i < FLASH_READY_PIN_NUM; i++){
+        if(_readyDrv[i] == NULL){
+            if(slot < 0) slot = i;
+        }else if(_readyDrv[i]->_readyPin == pin){
+            DBG("ready pin used by another module.");
+            return false;
+        }
+    }
+    if(slot < 0){
+        DBG("no free ready pin slot.");
+        return false;
+    }
+    _readyPin = pin;
+    _readyDrv[slot] = this;
+    pinMode(pin, INPUT);
+    attachInterrupt(digitalPinToInterrupt(pin), _readyISR[slot], RISING);
+    setReadyMode(true);
+    return true;
+}
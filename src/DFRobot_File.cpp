@@ -25,46 +25,319 @@
 #include <Arduino.h>
 #include "DFRobot_Flash_Moudle.h"
 #include "utility/DFRobot_Flash.h"
+#include "utility/DFRobot_Crc32.h"
 
-DFRobot_File::DFRobot_File(DFRobot_FlashFile f, const char *name){
-   _file = (DFRobot_FlashFile *)malloc(sizeof(DFRobot_FlashFile)); //请不要在析构函数里面随便free分配的空间
-   DBG((uint32_t)(uint32_t *)&_file, HEX);
-    if(_file){
-        memcpy(_file, &f, sizeof(DFRobot_FlashFile));
-        strncpy(_name, name, 31);
-        _name[31] = 0;
+DFRobot_File::sFileSlot_t DFRobot_File::_slots[FLASH_MAX_OPEN_FILES];
+uint32_t DFRobot_File::_tick = 0;
+
+#if FLASH_THREAD_SAFE
+//startDispatcher之前只有一个任务使用模块，锁还没有创建，加锁时直接跳过
+#if defined(ARDUINO_ARCH_ESP32)
+static SemaphoreHandle_t slotLock = NULL;
+static StaticSemaphore_t slotLockBuf;
+
+void DFRobot_File::SlotLock::start(){
+  if(slotLock == NULL) slotLock = xSemaphoreCreateRecursiveMutexStatic(&slotLockBuf);
+}
+
+DFRobot_File::SlotLock::SlotLock()
+  :_locked(slotLock != NULL){
+  if(_locked) xSemaphoreTakeRecursive(slotLock, portMAX_DELAY);
+}
+
+DFRobot_File::SlotLock::~SlotLock(){
+  if(_locked) xSemaphoreGiveRecursive(slotLock);
+}
+#else
+static pthread_mutex_t slotLock;
+static bool slotLockReady = false;
+
+void DFRobot_File::SlotLock::start(){
+  if(slotLockReady) return;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&slotLock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  slotLockReady = true;
+}
+
+DFRobot_File::SlotLock::SlotLock()
+  :_locked(slotLockReady){
+  if(_locked) pthread_mutex_lock(&slotLock);
+}
+
+DFRobot_File::SlotLock::~SlotLock(){
+  if(_locked) pthread_mutex_unlock(&slotLock);
+}
+#endif
+#endif
+
+DFRobot_File::DFRobot_File(DFRobot_FlashFile f, const char *name, const char *path)
+  :_slot(NULL){
+  FLASH_SLOT_LOCK();
+  sFileSlot_t *warm = NULL;
+  for(uint8_t i = 0; i < FLASH_MAX_OPEN_FILES; i++){
+    if(_slots[i].refs) continue;
+    if(!_slots[i].file.isOpen()){
+      _slot = &_slots[i];
+      break;
     }
-    DBG(_name);
+    if(!warm || ((int32_t)(_slots[i].lastUse - warm->lastUse) < 0)) warm = &_slots[i];
+  }
+  if((_slot == NULL) && warm){
+    //没有空闲槽位时关闭最久未用的暂留句柄
+    warm->file.close(false, false);
+    _slot = warm;
+  }
+  if(_slot == NULL){
+    DBG("no free file slot");
+    if(!f.isRoot()) f.close(false); //没有槽位保存，不能让模块上的文件一直处于打开状态
+    return;
+  }
+  _slot->file = f;
+  _slot->refs = 1;
+  _slot->crcStart = 0xFFFFFFFF;
+  _slot->owner = NULL;
+  _slot->lastUse = ++_tick;
+  _slot->evicted = false;
+  strncpy(_slot->name, name, sizeof(_slot->name) - 1);
+  _slot->name[sizeof(_slot->name) - 1] = 0;
+  if(!path || !joinPath(_slot->path, sizeof(_slot->path), path, "")){
+    _slot->path[0] = 0;
+  }
+  DBG(_slot->name);
 }
 
 DFRobot_File::DFRobot_File(void)
-  :_file(NULL){
-   _name[0] = 0;
+  :_slot(NULL){}
+
+DFRobot_File::DFRobot_File(const DFRobot_File &other)
+  :_slot(other._slot){
+  FLASH_SLOT_LOCK();
+  if(_slot) _slot->refs++;
+}
+
+DFRobot_File::DFRobot_File(DFRobot_File &&other)
+  :_slot(other._slot){
+  other._slot = NULL;
+}
+
+DFRobot_File::~DFRobot_File(){
+  release();
+}
+
+DFRobot_File &DFRobot_File::operator=(const DFRobot_File &other){
+  FLASH_SLOT_LOCK();
+  if(_slot != other._slot){
+    release();
+    _slot = other._slot;
+    if(_slot) _slot->refs++;
+  }
+  return *this;
+}
+
+DFRobot_File &DFRobot_File::operator=(DFRobot_File &&other){
+  if(this != &other){
+    release();
+    _slot = other._slot;
+    other._slot = NULL;
+  }
+  return *this;
+}
+
+bool DFRobot_File::release(){
+  bool ret = true;
+  if(_slot == NULL) return false;
+  FLASH_SLOT_LOCK();
+  if(--_slot->refs == 0){
+    //被换出的文件关闭时已经同步过
+    if(_slot->evicted){
+      _slot->evicted = false;
+    }else if(keepWarm(_slot)){
+      _slot = NULL;
+      return true;
+    }else if(_slot->file.isOpen() && !_slot->file.isRoot()){
+      ret = _slot->file.close(false);
+    }
+    _slot->file = DFRobot_FlashFile();
+  }
+  _slot = NULL;
+  return ret;
+}
+
+//最后一个引用释放时只同步文件，句柄留在槽位中，refs为0且文件仍打开的槽位即暂留句柄
+bool DFRobot_File::keepWarm(sFileSlot_t *slot){
+  if((FLASH_WARM_FILES == 0) || !slot->owner || !slot->path[0] || !slot->file.isFile()) return false;
+  if((slot->file.authority() != FILE_READ) && !slot->file.sync()) return false;
+  uint8_t n = 0;
+  sFileSlot_t *oldest = NULL;
+  for(uint8_t i = 0; i < FLASH_MAX_OPEN_FILES; i++){
+    sFileSlot_t *s = &_slots[i];
+    if((s == slot) || s->refs || (s->owner != slot->owner) || !s->file.isOpen()) continue;
+    n++;
+    if(!oldest || ((int32_t)(s->lastUse - oldest->lastUse) < 0)) oldest = s;
+  }
+  if(n >= FLASH_WARM_FILES){
+    oldest->file.close(false, false);
+    oldest->file = DFRobot_FlashFile();
+  }
+  slot->lastUse = ++_tick;
+  return true;
+}
+
+//模块上打开的文件和目录达到FLASH_DEVICE_HANDLES时腾出一个句柄：先关闭最久未用的暂留句柄，
+//没有暂留句柄时换出最久未读写的文件。目录要保留遍历位置、没有缓存路径的文件无法重新打开，都不换出
+bool DFRobot_File::makeRoom(DFRobot_FlashMoudle *owner){
+  FLASH_SLOT_LOCK();
+  uint8_t n = 0;
+  sFileSlot_t *victim = NULL;
+  for(uint8_t i = 0; i < FLASH_MAX_OPEN_FILES; i++){
+    sFileSlot_t *s = &_slots[i];
+    if((s->owner != owner) || !s->file.isOpen() || s->file.isRoot()) continue;
+    n++;
+    if(!s->file.isFile() || !s->path[0]) continue;
+    if(!victim || (!s->refs && victim->refs) ||
+       ((!s->refs == !victim->refs) && ((int32_t)(s->lastUse - victim->lastUse) < 0))){
+      victim = s;
+    }
+  }
+  //walk遍历中打开的目录也占用模块句柄
+  if(owner) n += owner->_card.walkHandles();
+  if(n < FLASH_DEVICE_HANDLES) return true;
+  if(victim == NULL) return false;
+  //暂留句柄在close时已经同步
+  victim->file.close(false, victim->refs != 0);
+  if(victim->refs){
+    victim->evicted = true;
+    DBG(victim->path);
+  }else{
+    victim->file = DFRobot_FlashFile();
+  }
+  return true;
+}
+
+//FAT文件名不区分大小写，暂留句柄的路径也按不区分大小写比较
+DFRobot_File DFRobot_File::reuse(DFRobot_FlashMoudle *owner, const char *path, uint8_t mode){
+  DFRobot_File f;
+  char buf[FLASH_PATH_CACHE_SIZE];
+  if((FLASH_WARM_FILES == 0) || !joinPath(buf, sizeof(buf), path, "")) return f;
+  FLASH_SLOT_LOCK();
+  for(uint8_t i = 0; i < FLASH_MAX_OPEN_FILES; i++){
+    sFileSlot_t *s = &_slots[i];
+    if(s->refs || (s->owner != owner) || !s->file.isFile() || (s->file.authority() != mode) || strcasecmp(s->path, buf)) continue;
+    //与重新打开一样，FILE_APPEND从末尾开始，其他权限从头开始
+    uint32_t pos = ((mode & FILE_APPEND) == FILE_APPEND) ? s->file.fileSize() : 0;
+    if((s->file.curPosition() != pos) && !s->file.seekSet(pos)){
+      s->file.close(false, false);
+      s->file = DFRobot_FlashFile();
+      return f;
+    }
+    s->refs = 1;
+    s->crcStart = 0xFFFFFFFF;
+    s->lastUse = ++_tick;
+    f._slot = s;
+    break;
+  }
+  return f;
+}
+
+void DFRobot_File::closeIdle(DFRobot_FlashMoudle *owner, const char *path){
+  char buf[FLASH_PATH_CACHE_SIZE];
+  if(path && !joinPath(buf, sizeof(buf), path, "")) path = NULL;
+  FLASH_SLOT_LOCK();
+  for(uint8_t i = 0; i < FLASH_MAX_OPEN_FILES; i++){
+    sFileSlot_t *s = &_slots[i];
+    if(s->refs || (s->owner != owner) || !s->file.isOpen()) continue;
+    if(path && strcasecmp(s->path, buf)) continue;
+    s->file.close(false, false);
+    s->file = DFRobot_FlashFile();
+  }
+}
+
+//需要模块句柄的操作通过io()取得文件：被换出的文件先重新打开。调用者在用完返回的文件之前持有槽位表的锁
+DFRobot_FlashFile &DFRobot_File::io(){
+  if(_slot->evicted && makeRoom(_slot->owner) && _slot->file.reopen(&_slot->owner->_root, _slot->path)){
+    _slot->evicted = false;
+  }
+  _slot->lastUse = ++_tick;
+  return _slot->file;
 }
 
 char *DFRobot_File::name(void) {
-  return _name;
+  static char empty[1] = "";
+  return _slot ? _slot->name : empty;
 }
 
 
+//把dir和name拼接成以'/'开头、不以'/'结尾、没有连续'/'的绝对路径，buf放不下时返回false
+bool DFRobot_File::joinPath(char *buf, uint16_t size, const char *dir, const char *name){
+  const char *parts[2] = {dir, name};
+  uint16_t n = 0;
+  for(uint8_t k = 0; k < 2; k++){
+    const char *p = parts[k];
+    while(*p){
+      while(*p == '/') p++;
+      if(*p == 0) break;
+      if(n + 1 >= size) return false;
+      buf[n++] = '/';
+      while(*p && (*p != '/')){
+        if(n + 1 >= size) return false;
+        buf[n++] = *p++;
+      }
+    }
+  }
+  if(n == 0){
+    if(size < 2) return false;
+    buf[n++] = '/';
+  }
+  buf[n] = 0;
+  return true;
+}
+
 String DFRobot_File::getAbsolutePath(){
   String str = "";
-  if(_file){
-    str = _file->absolutePath();
+  if(_slot){
+    if(_slot->path[0]) str = _slot->path;
+    else str = _slot->file.absolutePath();
   }
   return str;
 }
 
 String DFRobot_File::getParentDirectory(){
   String str = "";
-  if(_file){
-    str = _file->parentDirectory();
+  if(_slot){
+    char buf[FLASH_PATH_CACHE_SIZE];
+    if(_slot->path[0] && getParentDirectory(buf, sizeof(buf))) str = buf;
+    else str = _slot->file.parentDirectory();
   }
   return str;
 }
 
+bool DFRobot_File::getAbsolutePath(char *buf, uint16_t size){
+  if(!_slot || (buf == NULL) || (size == 0)) return false;
+  if(_slot->path[0] == 0) return _slot->file.absolutePath(buf, size) > 0;
+  uint16_t len = strlen(_slot->path);
+  if(len >= size) return false;
+  memcpy(buf, _slot->path, len + 1);
+  return true;
+}
+
+bool DFRobot_File::getParentDirectory(char *buf, uint16_t size){
+  if(!_slot || (buf == NULL) || (size == 0)) return false;
+  if(_slot->path[0] == 0) return _slot->file.parentDirectory(buf, size) > 0;
+  //根目录的父级目录仍为根目录
+  uint16_t len = strrchr(_slot->path, '/') - _slot->path;
+  if(len == 0) len = 1;
+  if(len >= size) return false;
+  memcpy(buf, _slot->path, len);
+  buf[len] = 0;
+  return true;
+}
+
 boolean DFRobot_File::isDirectory(void) {
-  return (_file && _file->isDir());
+  FLASH_SLOT_LOCK();
+  return (_slot && _slot->file.isDir());
 }
 
 size_t DFRobot_File::write(uint8_t val) {
@@ -73,75 +346,281 @@ size_t DFRobot_File::write(uint8_t val) {
 
 size_t DFRobot_File::write(const uint8_t *buf, size_t size) {
   size_t t;
-  if (!_file) {
+  if (!_slot) {
     return 0;
   }
-  t = _file->write(buf, size);
+  FLASH_SLOT_LOCK();
+  t = io().write(buf, size);
+  if (_slot->crcStart != 0xFFFFFFFF) {
+    _slot->crc = DFRobot_Crc32::update(_slot->crc, buf, t);
+    _slot->crcLen += t;
+  }
   return t;
 }
 
 int DFRobot_File::read() {
-  if (_file) 
-    return _file->read();
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return io().read();
   return -1;
 }
 
 int DFRobot_File::peek() {
-  if (! _file) 
+  if (! _slot) 
     return 0;
 
-  int c = _file->read();
-  if (c != -1) _file->seekCur(-1);
+  FLASH_SLOT_LOCK();
+  DFRobot_FlashFile &f = io();
+  int c = f.read();
+  if (c != -1) f.seekCur(-1);
   return c;
 }
 
 int DFRobot_File::read(void *buf, uint16_t nbyte) {
-  if (_file) 
-    return _file->read(buf, nbyte);
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return io().read(buf, nbyte);
   return 0;
 }
 
+size_t DFRobot_File::writev(const sIoVec_t *iov, uint8_t iovcnt) {
+  if (!_slot) 
+    return 0;
+  FLASH_SLOT_LOCK();
+  size_t t = io().writev(iov, iovcnt);
+  if (_slot->crcStart != 0xFFFFFFFF) {
+    size_t left = t;
+    for (uint8_t i = 0; (i < iovcnt) && left; i++) {
+      size_t n = iov[i].len < left ? iov[i].len : left;
+      _slot->crc = DFRobot_Crc32::update(_slot->crc, iov[i].buf, n);
+      left -= n;
+    }
+    _slot->crcLen += t;
+  }
+  return t;
+}
+
+int DFRobot_File::readv(const sIoVec_t *iov, uint8_t iovcnt) {
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return (int)io().readv(iov, iovcnt);
+  return 0;
+}
+
+int DFRobot_File::pread(uint32_t offset, void *buf, uint16_t nbyte) {
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return (int)io().pread(offset, buf, nbyte);
+  return 0;
+}
+
+int DFRobot_File::preadv(uint32_t offset, const sIoVec_t *iov, uint8_t iovcnt) {
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return (int)io().preadv(offset, iov, iovcnt);
+  return 0;
+}
+
+size_t DFRobot_File::pwrite(uint32_t offset, const void *buf, uint16_t nbyte) {
+  if (!_slot) 
+    return 0;
+  FLASH_SLOT_LOCK();
+  return io().pwrite(offset, buf, nbyte);
+}
+
+bool DFRobot_File::checksum(uint32_t *crc, uint32_t offset, uint32_t len) {
+  if (!_slot) return false;
+  FLASH_SLOT_LOCK();
+  return io().crc32(offset, len, crc);
+}
+
+uint8_t DFRobot_File::checksums(uint32_t *crcs, uint8_t count, uint32_t blockSize, uint32_t offset) {
+  if (!_slot) return 0;
+  FLASH_SLOT_LOCK();
+  return io().crc32Blocks(offset, blockSize, count, crcs);
+}
+
+bool DFRobot_File::syncFrom(Stream &src, uint32_t len, uint32_t *written) {
+  if (written) *written = 0;
+  if (!_slot) return false;
+  uint8_t buf[FLASH_COPY_BUF_SIZE];
+  uint32_t crcs[FLASH_SYNC_BLOCKS];
+  uint32_t size = this->size();
+  uint32_t offset = 0;
+  while (offset < len) {
+    //只有完整落在旧文件内的块才可能不用写，新内容结尾不足一块的部分单独作为一块查询
+    uint8_t count = 0;
+    while ((count < FLASH_SYNC_BLOCKS) && (offset + (count + 1) * (uint32_t)FLASH_COPY_BUF_SIZE <= size) &&
+           (offset + (count + 1) * (uint32_t)FLASH_COPY_BUF_SIZE <= len)) count++;
+    if (count) {
+      count = checksums(crcs, count, FLASH_COPY_BUF_SIZE, offset);
+    } else if ((len - offset < FLASH_COPY_BUF_SIZE) && (len <= size)) {
+      count = checksums(crcs, 1, len - offset, offset);
+    }
+    uint8_t i = 0;
+    do {
+      uint16_t n = (len - offset < FLASH_COPY_BUF_SIZE) ? (len - offset) : FLASH_COPY_BUF_SIZE;
+      if (src.readBytes(buf, n) != n) return false;
+      if ((i >= count) || (DFRobot_Crc32::update(0, buf, n) != crcs[i])) {
+        if (pwrite(offset, buf, n) != n) return false;
+        if (written) *written += n;
+      }
+      offset += n;
+    } while ((++i < count) && (offset < len));
+  }
+  return seek(len);
+}
+
+void DFRobot_File::startCrc() {
+  if (!_slot) return;
+  _slot->crcStart = position();
+  _slot->crcLen = 0;
+  _slot->crc = 0;
+}
+
+uint32_t DFRobot_File::crc() {
+  if (!_slot || (_slot->crcStart == 0xFFFFFFFF)) return 0;
+  return _slot->crc;
+}
+
+bool DFRobot_File::verify() {
+  uint32_t c;
+  if (!_slot || (_slot->crcStart == 0xFFFFFFFF)) return false;
+  if (!checksum(&c, _slot->crcStart, _slot->crcLen)) return false;
+  return c == _slot->crc;
+}
+
+uint32_t DFRobot_File::copyTo(Print &dst, uint32_t len) {
+  if (!_slot) return 0;
+  uint8_t buf[2][FLASH_COPY_BUF_SIZE];
+  uint16_t n[2] = {0, 0};   //两块缓存中的数据长度
+  uint16_t sent = 0;        //buf[cur]中已经交给dst的字节数
+  uint8_t cur = 0;
+  uint32_t total = 0;
+  uint32_t left = size() - position();
+  if (len < left) left = len;
+  //dst能查询可写空间时，每次只读一个发送缓存大小的数据，读的时间不超过发送缓存放空的时间，dst一直有数据可发；
+  //availableForWrite()为0时认为dst不能查询可写空间，整块读、整块阻塞写
+  uint16_t piece = FLASH_COPY_BUF_SIZE;
+  int room = dst.availableForWrite();
+  bool async = room > 0;
+  if (async && (room < piece)) piece = room;
+
+  while (true) {
+    if (async && (sent < n[cur])) {
+      room = dst.availableForWrite();
+      if (room > n[cur] - sent) room = n[cur] - sent;
+      if (room > 0) sent += dst.write(buf[cur] + sent, room);
+    }
+    if (n[cur] && (sent == n[cur])) {
+      total += n[cur];
+      n[cur] = 0;
+      sent = 0;
+      cur ^= 1;
+      continue;
+    }
+    //当前块为空时读当前块，否则在dst发送当前块的同时读另一块
+    uint8_t t = n[cur] ? (cur ^ 1) : cur;
+    if (left && ((t == cur) || (async && (n[t] < FLASH_COPY_BUF_SIZE)))) {
+      uint16_t want = FLASH_COPY_BUF_SIZE - n[t];
+      if (async && (want > piece)) want = piece;
+      if (want > left) want = left;
+      int r = read(buf[t] + n[t], want);
+      if (r <= 0) {
+        left = 0;
+      } else {
+        n[t] += r;
+        left -= r;
+      }
+      continue;
+    }
+    if (n[cur] == 0) break;
+    size_t w = dst.write(buf[cur] + sent, n[cur] - sent);
+    if (w == 0) break;
+    sent += w;
+  }
+  return total + sent;
+}
+
+uint32_t DFRobot_File::copyFrom(Stream &src, uint32_t len) {
+  if (!_slot) return 0;
+  uint8_t buf[FLASH_COPY_BUF_SIZE];
+  uint32_t total = 0;
+  while (total < len) {
+    uint32_t want = len - total;
+    if (want > FLASH_COPY_BUF_SIZE) want = FLASH_COPY_BUF_SIZE;
+    //readBytes等到凑满一块或超时，写flash期间串口收到的数据由中断存入接收缓存
+    size_t n = src.readBytes(buf, want);
+    if (n == 0) break;
+    size_t w = write(buf, n);
+    total += w;
+    if (w != n) break;
+  }
+  return total;
+}
+
 int DFRobot_File::available() {
-  if (! _file) return 0;
+  if (! _slot) return 0;
 
   uint32_t n = size() - position();
   return n > 0X7FFF ? 0X7FFF : n;
 }
 
 void DFRobot_File::flush() {
-  if (_file)
-    _file->sync();
+  //被换出的文件换出时已经同步
+  FLASH_SLOT_LOCK();
+  if (_slot && !_slot->evicted)
+    _slot->file.sync();
 }
 
 boolean DFRobot_File::seek(uint32_t pos) {
-  if (! _file) return false;
+  if (! _slot) return false;
+
+  FLASH_SLOT_LOCK();
+  return io().seekSet(pos);
+}
 
-  return _file->seekSet(pos);
+boolean DFRobot_File::reserve(uint32_t size) {
+  if (! _slot) return false;
+
+  FLASH_SLOT_LOCK();
+  return io().reserve(size);
 }
 
 uint32_t DFRobot_File::position() {
-  if (! _file) return -1;
-  return _file->curPosition();
+  if (! _slot) return -1;
+  FLASH_SLOT_LOCK();
+  return _slot->file.curPosition();
 }
 
 uint32_t DFRobot_File::size() {
-  if (! _file) return 0;
-  return _file->fileSize();
+  if (! _slot) return 0;
+  FLASH_SLOT_LOCK();
+  return _slot->file.fileSize();
 }
 
 bool DFRobot_File::close(bool truncate) {
   bool status = false;
-  if (_file) {
-    status = _file->close(truncate);
-    free(_file); 
-    _file = NULL;
+  FLASH_SLOT_LOCK();
+  if (_slot) {
+    //不截断关闭本槽位最后一个引用时由release同步并决定是否暂留句柄
+    if (_slot->evicted && !truncate) {
+      _slot->evicted = false;  //换出时已经同步并关闭
+      status = true;
+      release();
+    } else if (truncate || (_slot->refs > 1) || !_slot->file.isFile()) {
+      status = io().close(truncate);
+      release();
+    } else {
+      status = release();
+    }
   }
   return status;
 }
 
 DFRobot_File::operator bool() {
-  if (_file) 
-    return  _file->isOpen();
+  FLASH_SLOT_LOCK();
+  if (_slot) 
+    return  _slot->evicted || _slot->file.isOpen();
   return false;
 }
-
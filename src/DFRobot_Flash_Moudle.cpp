@@ -39,9 +39,20 @@
 DFRobot_File DFRobot_File::openNextFile(uint8_t mode) {
   char name[13];
   DFRobot_FlashFile f;
-  if(_file->readDir(name, sizeof(name)) == 0){
-    if(f.open(_file, name, mode)){
-      return DFRobot_File(f, name);
+  FLASH_SLOT_LOCK();
+  if(_slot && (_slot->file.readDir(name, sizeof(name)) == 0)){
+    makeRoom(_slot->owner);
+    if(f.open(_slot->file, name, mode)){
+      //子项的路径由本目录缓存的路径加上名字得到，本目录没有缓存路径时子项也不缓存
+      char path[FLASH_PATH_CACHE_SIZE];
+      DFRobot_File ret;
+      if(_slot->path[0] && joinPath(path, sizeof(path), _slot->path, name)){
+        ret = DFRobot_File(f, name, path);
+      }else{
+        ret = DFRobot_File(f, name);
+      }
+      if(ret._slot) ret._slot->owner = _slot->owner;
+      return ret;
     }else{
       return DFRobot_File();
     }
@@ -51,7 +62,7 @@ DFRobot_File DFRobot_File::openNextFile(uint8_t mode) {
 
 void DFRobot_File::rewindDirectory(void) {  
   if (isDirectory()){
-     _file->rewind();
+     _slot->file.rewind();
   }else{
      DBG("is not dir");
   }
@@ -92,11 +103,16 @@ void DFRobot_FlashMoudle::getParentDir(const char *filepath, int *index){
 
 /*获取卡的基本信息*/
 uint8_t DFRobot_FlashMoudle::begin(DFRobot_Driver *drv) {
+  DFRobot_File::closeIdle(this);
   return (_card.init(drv) | _root.openRoot(_card));
 }
  
 //打开文件
 DFRobot_File DFRobot_FlashMoudle::open(const char *filepath, uint8_t mode){
+  return open(filepath, mode, false);
+}
+
+DFRobot_File DFRobot_FlashMoudle::open(const char *filepath, uint8_t mode, bool knownFile){
   DFRobot_FlashFile file;
   int pathidx;
   char *pathsave = (char *)filepath;
@@ -111,10 +127,19 @@ DFRobot_File DFRobot_FlashMoudle::open(const char *filepath, uint8_t mode){
 
   if (!filepath[0]) {
     // it was the directory itself!
-    return DFRobot_File(_root, "/");
+    return DFRobot_File(_root, "/", "/");
   }
 
-  if (!file.open(_root, pathsave, mode)) {
+  //刚关闭的同一文件直接使用暂留的句柄；权限不同时先关闭暂留句柄，避免同一文件在模块上打开两次
+  //从腾出句柄到新文件占用槽位之间不能被其他任务抢走
+  FLASH_SLOT_LOCK();
+  DFRobot_File warm = DFRobot_File::reuse(this, pathsave, mode);
+  if (warm) return warm;
+  DFRobot_File::closeIdle(this, pathsave);
+  DFRobot_File::makeRoom(this);
+
+  //已知是文件时(如walk列出的目录项)不再查询属性
+  if (!(knownFile ? file.openFile(&_root, pathsave, mode) : file.open(_root, pathsave, mode))) {
       // failed to open the file :(
       return DFRobot_File();
   }
@@ -132,7 +157,9 @@ DFRobot_File DFRobot_FlashMoudle::open(const char *filepath, uint8_t mode){
     // close the parent
     parentdir.close();
   }*/
-  return DFRobot_File(file, filepath);
+  DFRobot_File ret(file, filepath, pathsave);
+  if (ret._slot) ret._slot->owner = this;
+  return ret;
 }
 
 boolean DFRobot_FlashMoudle::exists(const char *filepath) {
@@ -145,11 +172,12 @@ boolean DFRobot_FlashMoudle::mkdir(const char *filepath) {
     A rough equivalent to `mkdir -p`.
    */
   if(exists(filepath)) return true;
-  return _root.makeDir(filepath);
+  return _root.makeDirs(filepath);
 }
 
 boolean DFRobot_FlashMoudle::remove(const char *filepath) {
   DFRobot_FlashFile child;
+  DFRobot_File::closeIdle(this, filepath);
   return _root.remove(filepath);
 }
 
@@ -157,4 +185,404 @@ boolean DFRobot_FlashMoudle::rmdir(const char *filepath) {
   return remove(filepath);
 }
 
+uint16_t DFRobot_FlashMoudle::append(const char *filepath, const void *buf, uint16_t len) {
+  if (!_root.isOpen()) return 0;
+  //暂留句柄记录的文件大小会过时
+  DFRobot_File::closeIdle(this, filepath);
+  return _root.append(filepath, buf, len, FILE_APPEND);
+}
+
+uint8_t DFRobot_FlashMoudle::stat(const char *const *filepaths, uint8_t *attrs, uint8_t num) {
+  if (!_root.isOpen()) return 0;
+  return _root.getAttributes(filepaths, attrs, num);
+}
+
+boolean DFRobot_FlashMoudle::removeTree(const char *filepath) {
+  if (!_root.isOpen()) return false;
+  DFRobot_File::closeIdle(this);
+  return _root.removeTree(filepath);
+}
+
+boolean DFRobot_FlashMoudle::copy(const char *from, const char *to, DFRobot_FlashMoudle *dst) {
+  if (dst == NULL) dst = this;
+  if (dst == this) {
+    //源和目标是同一个文件时，下面删除目标会删掉正在读的源文件；FAT文件名不区分大小写
+    char a[FLASH_PATH_MAX], b[FLASH_PATH_MAX];
+    if (!DFRobot_File::joinPath(a, sizeof(a), from, "") || !DFRobot_File::joinPath(b, sizeof(b), to, "")) return false;
+    if (strcasecmp(a, b) == 0) return false;
+  }
+  DFRobot_File in = open(from);
+  if (!in || in.isDirectory()) return false;
+  if (dst->exists(to) && !dst->remove(to)) return false;
+  DFRobot_File out = dst->open(to, FILE_WRITE);
+  if (!out) return false;
+  uint32_t n = in.copyTo(out);
+  bool ok = (n == in.size());
+  in.close();
+  return out.close() && ok;
+}
+
+boolean DFRobot_FlashMoudle::rename(const char *from, const char *to) {
+  if (!_root.isOpen() || (from == NULL) || (to == NULL)) return false;
+  //移动目录时其下文件的暂留句柄路径会失效，全部关闭
+  DFRobot_File::closeIdle(this);
+  if (_card._pro.isSupported(DFRobot_DFR0870_Protocol::eFeatureRename)) {
+    return _root.rename(from, to);
+  }
+  //模块不支持重命名命令时只能复制后删除，不支持目录；目标已存在时拒绝，复制到一半出错也不会丢失任何一方的数据
+  if (exists(to)) return false;
+  return copy(from, to) && remove(from);
+}
+
+//临时文件与目标文件在同一目录，文件名相同，扩展名为$$$
+static bool replaceTempPath(char *buf, uint16_t size, const char *filepath) {
+  const char *name = strrchr(filepath, '/');
+  name = name ? (name + 1) : filepath;
+  const char *dot = strchr(name, '.');
+  uint16_t len = dot ? (dot - filepath) : strlen(filepath);
+  if (!name[0] || (len + 5 > size)) return false;
+  memcpy(buf, filepath, len);
+  memcpy(buf + len, ".$$$", 5);
+  return strcmp(buf, filepath) != 0;
+}
+
+boolean DFRobot_FlashMoudle::replace(const char *filepath, const void *buf, uint32_t len) {
+  char tmp[FLASH_PATH_MAX];
+  if (!replaceSupported() || (filepath == NULL) || ((buf == NULL) && len) || !replaceTempPath(tmp, sizeof(tmp), filepath)) return false;
+  if (exists(tmp) && !remove(tmp)) return false;
+  DFRobot_File out = open(tmp, FILE_WRITE);
+  if (!out) return false;
+  out.startCrc();
+  //底层单次写入长度为16位，大文件分块写入
+  const uint8_t *p = (const uint8_t *)buf;
+  uint32_t done = 0;
+  bool ok = true;
+  while (ok && (done < len)) {
+    uint16_t n = (len - done > 0x8000) ? 0x8000 : (uint16_t)(len - done);
+    ok = (out.write(p + done, n) == n);
+    done += n;
+  }
+  ok = ok && out.verify();
+  return replaceCommit(out, tmp, filepath, ok);
+}
+
+boolean DFRobot_FlashMoudle::replace(const char *filepath, Stream &src, uint32_t len) {
+  char tmp[FLASH_PATH_MAX];
+  if (!replaceSupported() || (filepath == NULL) || !replaceTempPath(tmp, sizeof(tmp), filepath)) return false;
+  if (exists(tmp) && !remove(tmp)) return false;
+  DFRobot_File out = open(tmp, FILE_WRITE);
+  if (!out) return false;
+  out.startCrc();
+  bool ok = (out.copyFrom(src, len) == len) && out.verify();
+  return replaceCommit(out, tmp, filepath, ok);
+}
+
+boolean DFRobot_FlashMoudle::replaceSupported() {
+  //没有重命名命令时无法在不删除目标文件的前提下替换它，直接失败，不写入任何数据
+  if (_card._pro.isSupported(DFRobot_DFR0870_Protocol::eFeatureRename)) return true;
+  DBG("replace needs CMD_RENAME");
+  return false;
+}
+
+boolean DFRobot_FlashMoudle::replaceCommit(DFRobot_File &out, const char *tmp, const char *filepath, bool ok) {
+  ok = out.close() && ok;
+  if (ok && rename(tmp, filepath)) return true;
+  DBG("replace fail, remove temp file");
+  remove(tmp);
+  return false;
+}
+
+#define WALK_ATTR_DIR    5    ///< walk回调中子目录的attr
+
+typedef struct{
+  DFRobot_FlashMoudle *flash;
+  DFRobot_FlashWalkCallback cb;
+  void *arg;
+}sWalk_t;
+
+//回调返回后walk就要打开这个子目录，先为它腾出句柄
+bool DFRobot_FlashMoudle::walkEntry(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg){
+  sWalk_t *w = (sWalk_t *)arg;
+  if (!w->cb(path, attr, size, depth, w->arg)) return false;
+  if (attr == WALK_ATTR_DIR) DFRobot_File::makeRoom(w->flash);
+  return true;
+}
+
+boolean DFRobot_FlashMoudle::walk(const char *filepath, DFRobot_FlashWalkCallback cb, void *arg) {
+  if (!_root.isOpen() || (cb == NULL)) return false;
+  sWalk_t w = {this, cb, arg};
+  DFRobot_File::makeRoom(this);
+  return _root.walk(filepath, walkEntry, &w);
+}
+
+#define TAR_BLOCK        512
+#define TAR_NAME_SIZE    100
+#define TAR_PREFIX_SIZE  155
+
+typedef struct{
+  DFRobot_FlashMoudle *flash;
+  Print *out;
+  uint16_t baseLen;  ///< 导出目录路径的长度，包内路径从其后的'/'之后开始
+}sTarExport_t;
+
+static void tarOctal(char *buf, uint8_t width, uint32_t v){
+  buf[width - 1] = '\0';
+  for(int8_t i = width - 2; i >= 0; i--){
+    buf[i] = '0' + (v & 7);
+    v >>= 3;
+  }
+}
+
+static uint32_t tarSum(const char *s, uint16_t n){
+  uint32_t sum = 0;
+  while(n--) sum += (uint8_t)*s++;
+  return sum;
+}
+
+static void tarZeros(Print &out, uint16_t n){
+  static const uint8_t zeros[32] = {0};
+  while(n){
+    uint16_t k = (n < sizeof(zeros)) ? n : sizeof(zeros);
+    out.write(zeros, k);
+    n -= k;
+  }
+}
 
+static void tarField(Print &out, const char *s, uint16_t n, uint16_t width){
+  out.write((const uint8_t *)s, n);
+  tarZeros(out, width - n);
+}
+
+/**
+ * @brief 输出一个ustar头部块，不缓存整块，先算出校验和再逐个字段输出。路径超过100字节时在'/'处拆到prefix字段
+ */
+static bool tarHeader(Print &out, const char *rel, bool dir, uint32_t size){
+  uint16_t len = strlen(rel);
+  uint16_t full = len + (dir ? 1 : 0);
+  uint16_t split = 0;
+  if(full > TAR_NAME_SIZE){
+    for(split = 1; split < len; split++){
+      if((rel[split] == '/') && (full - split - 1 <= TAR_NAME_SIZE)) break;
+    }
+    if((split >= len) || (split > TAR_PREFIX_SIZE)) return false;
+  }
+  const char *name = split ? (rel + split + 1) : rel;
+  uint16_t nameLen = len - (name - rel);
+  char mode[8], id[8], sz[12], mtime[12], chk[8];
+  tarOctal(mode, sizeof(mode), dir ? 0755 : 0644);
+  tarOctal(id, sizeof(id), 0);
+  tarOctal(sz, sizeof(sz), dir ? 0 : size);
+  tarOctal(mtime, sizeof(mtime), 0);
+  char type = dir ? '5' : '0';
+  //校验和按chksum字段为8个空格计算
+  uint32_t sum = tarSum(rel, split) + tarSum(name, nameLen) + (dir ? '/' : 0) + tarSum(mode, 7) + 2 * tarSum(id, 7) +
+                 tarSum(sz, 11) + tarSum(mtime, 11) + 8 * ' ' + type + tarSum("ustar00", 7);
+  tarOctal(chk, 7, sum);
+  chk[7] = ' ';
+
+  out.write((const uint8_t *)name, nameLen);
+  if(dir) out.write('/');
+  tarZeros(out, TAR_NAME_SIZE - nameLen - (dir ? 1 : 0));
+  tarField(out, mode, 8, 8);
+  tarField(out, id, 8, 8);
+  tarField(out, id, 8, 8);
+  tarField(out, sz, 12, 12);
+  tarField(out, mtime, 12, 12);
+  tarField(out, chk, 8, 8);
+  out.write(type);
+  tarZeros(out, 100);                  //linkname
+  tarField(out, "ustar\0" "00", 8, 8); //magic, version
+  tarZeros(out, 32 + 32 + 8 + 8);      //uname, gname, devmajor, devminor
+  tarField(out, rel, split, TAR_PREFIX_SIZE);
+  tarZeros(out, 12);
+  return true;
+}
+
+bool DFRobot_FlashMoudle::tarExportEntry(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg){
+  (void)depth;
+  sTarExport_t *tar = (sTarExport_t *)arg;
+  bool dir = (attr == WALK_ATTR_DIR);
+  if(!tarHeader(*tar->out, path + tar->baseLen + 1, dir, size)) return false;
+  if(dir) return true;
+  DFRobot_File f = tar->flash->open(path, FILE_READ, true);
+  if(!f) return false;
+  uint32_t n = f.copyTo(*tar->out, size);
+  f.close();
+  if(n != size) return false;
+  tarZeros(*tar->out, (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+  return true;
+}
+
+boolean DFRobot_FlashMoudle::exportTree(const char *filepath, Print &out) {
+  sTarExport_t tar;
+  tar.flash = this;
+  tar.out = &out;
+  //与walk一样去掉结尾的'/'，根目录的路径为空
+  tar.baseLen = strlen(filepath);
+  while (tar.baseLen && (filepath[tar.baseLen - 1] == '/')) tar.baseLen--;
+  if (!walk(filepath, tarExportEntry, &tar)) return false;
+  tarZeros(out, 2 * TAR_BLOCK);
+  return true;
+}
+
+/**
+ * @brief 从in读取n字节，buf为NULL时丢弃；sum不为NULL时累加校验和
+ */
+static bool tarRead(Stream &in, void *buf, uint32_t n, uint32_t *sum){
+  uint8_t tmp[32];
+  uint8_t *p = (uint8_t *)buf;
+  while(n){
+    uint16_t k = p ? ((n < 0xFFFF) ? n : 0xFFFF) : ((n < sizeof(tmp)) ? n : sizeof(tmp));
+    uint8_t *dst = p ? p : tmp;
+    if(in.readBytes(dst, k) != k) return false;
+    if(sum) *sum += tarSum((const char *)dst, k);
+    if(p) p += k;
+    n -= k;
+  }
+  return true;
+}
+
+/**
+ * @brief 读掉结束块之后的全0块：第二个结束块和GNU tar补齐到整条记录(默认10KB)的块，读到不是0的数据或in超时为止
+ */
+static void tarSkipZeros(Stream &in){
+  uint8_t tmp[32];
+  while(true){
+    size_t n = in.readBytes(tmp, sizeof(tmp));
+    for(size_t i = 0; i < n; i++){
+      if(tmp[i]) return;
+    }
+    if(n != sizeof(tmp)) return;
+  }
+}
+
+/**
+ * @brief 检查包内路径中没有..目录，a..b这样的文件名是合法的
+ */
+static bool tarSafePath(const char *rel){
+  const char *p = rel;
+  while(*p){
+    const char *end = strchr(p, '/');
+    uint16_t n = end ? (end - p) : strlen(p);
+    if((n == 2) && (p[0] == '.') && (p[1] == '.')) return false;
+    if(!end) break;
+    p = end + 1;
+  }
+  return true;
+}
+
+/**
+ * @brief 从pax扩展头部的数据中取出path记录，记录格式为"长度 key=value\n"，长度包括整条记录
+ */
+static bool tarPaxPath(Stream &in, uint32_t size, char *path, uint16_t pathSize){
+  while(size){
+    uint32_t len = 0, used = 0;
+    char c = 0;
+    while(c != ' '){
+      if((used >= size) || (in.readBytes(&c, 1) != 1)) return false;
+      used++;
+      if((c != ' ') && ((c < '0') || (c > '9'))) return false;
+      if(c != ' ') len = len * 10 + (c - '0');
+    }
+    if((len > size) || (len < used + 2)) return false;
+    //只关心key为path的记录，其余整条丢弃
+    uint8_t k = 0;
+    bool isPath = true;
+    while(true){
+      if((used >= len - 1) || (in.readBytes(&c, 1) != 1)) return false;
+      used++;
+      if(c == '=') break;
+      if((k >= 4) || ("path"[k] != c)) isPath = false;
+      k++;
+    }
+    uint32_t valueLen = len - used - 1;
+    if(isPath && (k == 4)){
+      if(valueLen >= pathSize) return false;
+      if(!tarRead(in, path, valueLen, NULL)) return false;
+      path[valueLen] = '\0';
+    }else if(!tarRead(in, NULL, valueLen, NULL)){
+      return false;
+    }
+    if(!tarRead(in, NULL, 1, NULL)) return false;   //'\n'
+    size -= len;
+  }
+  return true;
+}
+
+boolean DFRobot_FlashMoudle::importTree(const char *filepath, Stream &in) {
+  //prefix读到rel开头，name读到rel + 156，拼成prefix/name
+  char rel[TAR_PREFIX_SIZE + 1 + TAR_NAME_SIZE + 1];
+  char *name = rel + TAR_PREFIX_SIZE + 1;
+  char path[FLASH_PATH_MAX];
+  char longName[FLASH_PATH_MAX];
+  char sz[13], chk[9], type;
+  bool hasLongName = false;
+  if (!DFRobot_File::joinPath(path, sizeof(path), filepath, "")) return false;
+  if ((strcmp(path, "/") != 0) && !mkdir(path)) return false;
+  while (true) {
+    uint32_t sum = 0;
+    if (!tarRead(in, name, TAR_NAME_SIZE, &sum)) return false;
+    name[TAR_NAME_SIZE] = '\0';
+    if (!tarRead(in, NULL, 24, &sum)) return false;             //mode, uid, gid
+    if (!tarRead(in, sz, 12, &sum)) return false;
+    sz[12] = '\0';
+    if (!tarRead(in, NULL, 12, &sum)) return false;             //mtime
+    if (!tarRead(in, chk, 8, NULL)) return false;
+    chk[8] = '\0';
+    sum += 8 * ' ';
+    if (!tarRead(in, &type, 1, &sum)) return false;
+    if (!tarRead(in, NULL, 188, &sum)) return false;            //linkname ~ devminor
+    if (!tarRead(in, rel, TAR_PREFIX_SIZE, &sum)) return false;
+    rel[TAR_PREFIX_SIZE] = '\0';
+    if (!tarRead(in, NULL, 12, &sum)) return false;
+    //全0的块表示tar包结束，后面的全0块也读掉，不留在in中给调用者当作下一条数据
+    if (sum == 8 * ' ') {
+      tarSkipZeros(in);
+      return true;
+    }
+    if (strtoul(chk, NULL, 8) != sum) {
+      DBG("tar checksum error");
+      return false;
+    }
+    uint32_t size = strtoul(sz, NULL, 8);
+    uint32_t pad = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    //GNU的'L'和pax的'x'给出下一项的完整路径，放不下时拒绝整个包，不用截断的名字解包
+    if ((type == 'L') || (type == 'x')) {
+      if (type == 'L') {
+        if ((size == 0) || (size >= sizeof(longName)) || !tarRead(in, longName, size, NULL)) return false;
+        longName[size] = '\0';
+        hasLongName = true;
+      } else {
+        longName[0] = '\0';
+        if (!tarPaxPath(in, size, longName, sizeof(longName))) return false;
+        if (longName[0]) hasLongName = true;
+      }
+      if (!tarRead(in, NULL, pad, NULL)) return false;
+      continue;
+    }
+    if (hasLongName) {
+      strcpy(rel, longName);
+      hasLongName = false;
+    } else {
+      uint16_t len = strlen(rel);
+      if (len) rel[len++] = '/';
+      memmove(rel + len, name, strlen(name) + 1);
+    }
+    //不允许用..写到目标目录之外
+    if (!tarSafePath(rel)) return false;
+    if (!DFRobot_File::joinPath(path, sizeof(path), filepath, rel)) return false;
+    uint32_t skip = size;
+    if (type == '5') {
+      if (!mkdir(path)) return false;
+    } else if ((type == '0') || (type == '\0')) {
+      if (exists(path) && !remove(path)) return false;
+      DFRobot_File f = open(path, FILE_WRITE);
+      if (!f) return false;
+      f.reserve(size);
+      uint32_t n = f.copyFrom(in, size);
+      if (!f.close() || (n != size)) return false;
+      skip = 0;
+    }
+    if (!tarRead(in, NULL, skip + pad, NULL)) return false;
+  }
+}
@@ -26,6 +26,7 @@
 #include "utility/DFRobot_Flash.h"
 #include "utility/DFRobot_Driver.h"
 #include "utility/DFRobot_FatCmd.h"
+#include "utility/DFRobot_Codec.h"
 
 
 ///< Define DBG, change 0 to 1 open the DBG, 1 to 0 to close.  
@@ -39,18 +40,107 @@
 #define FILE_WRITE (0x01 | 0x02 | 0x10) //read write ALWAYS  apend:0x30
 #define FILE_APPEND		(0x01 | 0x02 | 0x10 | 0x30)
 
+///< 能同时打开的文件和目录数，即DFRobot_File句柄槽位表的大小，AVR上默认4个以节省RAM
+///< 可以大于模块的句柄数，超出FLASH_DEVICE_HANDLES时最久未读写的文件被换出，下次读写时自动重新打开
+#ifndef FLASH_MAX_OPEN_FILES
+#if defined(__AVR__)
+#define FLASH_MAX_OPEN_FILES  4
+#else
+#define FLASH_MAX_OPEN_FILES  16
+#endif
+#endif
+
+///< DFRobot_File能占用的模块句柄数，模块最多同时打开8个文件和目录，根目录占用1个；
+///< 同时使用KVStore等直接打开文件的类时应相应减小
+#ifndef FLASH_DEVICE_HANDLES
+#define FLASH_DEVICE_HANDLES  7
+#endif
+
+///< close后暂不关闭、留给下次open同一文件直接使用的句柄数，0表示关闭后立即释放句柄
+#ifndef FLASH_WARM_FILES
+#define FLASH_WARM_FILES  2
+#endif
+
+///< 打开文件时缓存的绝对路径的最大长度(含'\0')，路径更长时getAbsolutePath仍向模块查询，AVR上默认32字节以节省RAM
+#ifndef FLASH_PATH_CACHE_SIZE
+#if defined(__AVR__)
+#define FLASH_PATH_CACHE_SIZE  32
+#else
+#define FLASH_PATH_CACHE_SIZE  FLASH_PATH_MAX
+#endif
+#endif
+
+///< copyTo/copyFrom每块的大小，copyTo使用两块交替，AVR上默认64字节以节省RAM
+#ifndef FLASH_COPY_BUF_SIZE
+#if defined(__AVR__)
+#define FLASH_COPY_BUF_SIZE  64
+#else
+#define FLASH_COPY_BUF_SIZE  512
+#endif
+#endif
+
+///< syncFrom每次用一条批处理命令查询的块数，每块FLASH_COPY_BUF_SIZE字节
+#ifndef FLASH_SYNC_BLOCKS
+#define FLASH_SYNC_BLOCKS  16
+#endif
+
+///< 访问文件槽位表的函数开头加锁，见DFRobot_File::SlotLock
+#if FLASH_THREAD_SAFE
+#define FLASH_SLOT_LOCK()  DFRobot_File::SlotLock slotLock
+#else
+#define FLASH_SLOT_LOCK()
+#endif
+
+class DFRobot_FlashMoudle;
+
 class DFRobot_File : public Stream{
 private:
- DFRobot_FlashFile *_file;
- char _name[32];
+  typedef struct{
+    DFRobot_FlashFile file;
+    char name[13];     ///< 8.3短文件名
+    uint8_t refs;      ///< 引用此槽位的DFRobot_File个数，0表示槽位空闲
+    char path[FLASH_PATH_CACHE_SIZE]; ///< 打开时缓存的绝对路径，空字符串表示没有缓存
+    uint32_t crcStart; ///< startCrc时的文件位置，0xFFFFFFFF表示没有跟踪写入数据的CRC
+    uint32_t crcLen;   ///< startCrc之后写入的字节数
+    uint32_t crc;      ///< startCrc之后写入数据的CRC-32
+    DFRobot_FlashMoudle *owner; ///< 打开此文件的模块，为NULL时不换出也不暂留
+    uint32_t lastUse;  ///< 最近一次读写的序号，换出时选择最久未用的文件
+    bool evicted;      ///< 模块上的句柄已被换出，下次读写前按path重新打开
+  }sFileSlot_t;
+  static sFileSlot_t _slots[FLASH_MAX_OPEN_FILES];
+  static uint32_t _tick;
+  sFileSlot_t *_slot;
+  friend class DFRobot_FlashMoudle;
+  bool release();
+  DFRobot_FlashFile &io();
+  static bool keepWarm(sFileSlot_t *slot);
+  static bool makeRoom(DFRobot_FlashMoudle *owner);
+  static DFRobot_File reuse(DFRobot_FlashMoudle *owner, const char *path, uint8_t mode);
+  static void closeIdle(DFRobot_FlashMoudle *owner, const char *path = NULL);
+  static bool joinPath(char *buf, uint16_t size, const char *dir, const char *name);
+#if FLASH_THREAD_SAFE
+  /**
+   * @brief 槽位表的锁，startDispatcher之后生效：多个任务同时打开、关闭、换出文件时互斥访问槽位表。
+   * @n 同一任务可以重复加锁；每个读写操作在整个过程中持有，其他任务不能在中途换出它正在使用的句柄
+   */
+  class SlotLock{
+  public:
+    SlotLock();
+    ~SlotLock();
+    static void start();
+  private:
+    bool _locked;
+  };
+#endif
 public:
   /**
    * @fn DFRobot_File
-   * @brief DFRobot_File类构造
+   * @brief DFRobot_File类构造，从静态槽位表中分配一个槽位保存文件，槽位已满时得到一个未打开的对象
    * @param f DFRobot_FlashFile类对象
    * @param name 文件名
+   * @param path 文件的绝对路径，缓存在槽位中；为NULL或超过FLASH_PATH_CACHE_SIZE时不缓存，查询路径时向模块查询
    */
-  DFRobot_File(DFRobot_FlashFile f, const char *name);
+  DFRobot_File(DFRobot_FlashFile f, const char *name, const char *path = NULL);
 
   /**
    * @fn DFRobot_File
@@ -58,6 +148,27 @@ public:
    */
   DFRobot_File(void);
 
+  /**
+   * @fn DFRobot_File
+   * @brief 拷贝构造，两个对象共享同一个槽位
+   */
+  DFRobot_File(const DFRobot_File &other);
+
+  /**
+   * @fn DFRobot_File
+   * @brief 移动构造，槽位转移给新对象，other变为未打开的对象
+   */
+  DFRobot_File(DFRobot_File &&other);
+
+  /**
+   * @fn ~DFRobot_File
+   * @brief 析构函数，最后一个引用槽位的对象析构时自动关闭文件并释放槽位
+   */
+  ~DFRobot_File();
+
+  DFRobot_File &operator=(const DFRobot_File &other);
+  DFRobot_File &operator=(DFRobot_File &&other);
+
   /**
    * @fn name
    * @brief Strorage type and thehe file or directory name.
@@ -67,17 +178,39 @@ public:
 
   /**
    * @fn getAbsolutePath
-   * @brief Get absolute path of file or directory.
+   * @brief Get absolute path of file or directory. 路径在打开时缓存，不需要向模块查询
    * @return The absolute path of file or directory.
    */
   String getAbsolutePath();
 
   /**
    * @fn getParentDirectory
-   * @brief Get parent directory of file or directory.
+   * @brief Get parent directory of file or directory. 由缓存的路径得到，不需要向模块查询
    * @return The parent directory path of file or directory.
    */
   String getParentDirectory();
+
+  /**
+   * @fn getAbsolutePath
+   * @brief Get absolute path of file or directory into buf, 不申请堆内存，适合在循环中调用
+   * @param buf  保存路径，以'\0'结尾
+   * @param size buf的大小
+   * @return 获取结果
+   * @retval true  成功
+   * @retval false 文件未打开、buf太小或查询失败
+   */
+  bool getAbsolutePath(char *buf, uint16_t size);
+
+  /**
+   * @fn getParentDirectory
+   * @brief Get parent directory of file or directory into buf, 不申请堆内存，适合在循环中调用
+   * @param buf  保存路径，以'\0'结尾
+   * @param size buf的大小
+   * @return 获取结果
+   * @retval true  成功
+   * @retval false 文件未打开、buf太小或查询失败
+   */
+  bool getParentDirectory(char *buf, uint16_t size);
   
   /**
    * @fn write
@@ -112,6 +245,196 @@ public:
    */
   int read(void *buf, uint16_t nbyte);
   
+  /**
+   * @fn writev
+   * @brief Write several buffers into file in order with a single write command, 各段数据直接从用户缓存发送，无需拼接到临时缓存
+   * @param iov 缓存段数组，sIoVec_t{buf, len}
+   * @param iovcnt 缓存段个数
+   * @return Returns the size in bytes written
+   */
+  size_t writev(const sIoVec_t *iov, uint8_t iovcnt);
+
+  /**
+   * @fn readv
+   * @brief Read from file into several buffers in order with a single read command, 文件读指针自动增加
+   * @param iov 缓存段数组，sIoVec_t{buf, len}
+   * @param iovcnt 缓存段个数
+   * @return Returns the size in bytes read, -1 on failure
+   */
+  int readv(const sIoVec_t *iov, uint8_t iovcnt);
+
+  /**
+   * @fn pread
+   * @brief Read multiple bytes at the given offset, 文件读指针position()不变
+   * @param offset 读取位置，不能超过文件大小
+   * @param buf 存储从文件中读取的数据
+   * @param nbyte 要读取的字节的数量
+   * @return Returns the size in bytes read, -1 on failure
+   */
+  int pread(uint32_t offset, void *buf, uint16_t nbyte);
+
+  /**
+   * @fn preadv
+   * @brief Read at the given offset into several buffers in order with a single command, 文件读指针position()不变
+   * @param offset 读取位置，不能超过文件大小
+   * @param iov 缓存段数组，sIoVec_t{buf, len}
+   * @param iovcnt 缓存段个数
+   * @return Returns the size in bytes read, -1 on failure
+   */
+  int preadv(uint32_t offset, const sIoVec_t *iov, uint8_t iovcnt);
+
+  /**
+   * @fn pwrite
+   * @brief Write multiple bytes at the given offset, 文件写指针position()不变，offset等于文件大小时为追加
+   * @param offset 写入位置，不能超过文件大小
+   * @param buf 要写入的数据
+   * @param nbyte 要写入的字节的数量
+   * @return Returns the size in bytes written
+   */
+  size_t pwrite(uint32_t offset, const void *buf, uint16_t nbyte);
+
+  /**
+   * @fn write<T>
+   * @brief 按小端格式写入一个值，编码规则见DFRobot_Codec.h，整条记录先编码到栈上的缓存，再一次写入
+   * @n 必须显式写出类型，例如file.write<int32_t>(n)、file.write<sSample_t>(s)
+   * @param v 要写入的值，可以是定宽整数(int8_t~uint64_t)、浮点数、bool、数组或特化了DFRobot_Codec的自定义类型
+   * @return Returns the size in bytes written, 写入不完整时返回0
+   */
+  template<typename T>
+  size_t write(const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    DFRobot_Codec<T>::encode(buf, v);
+    return (write(buf, sizeof(buf)) == sizeof(buf)) ? sizeof(buf) : 0;
+  }
+
+  /**
+   * @fn read<T>
+   * @brief 读出一个按小端格式写入的值，一次读文件命令
+   * @param v 保存读出的值，类型由参数推导
+   * @return 读取结果
+   * @retval true  成功
+   * @retval false 剩余数据不足一个值或读取失败
+   */
+  template<typename T>
+  bool read(T &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(read(buf, sizeof(buf)) != (int)sizeof(buf)) return false;
+    DFRobot_Codec<T>::decode(buf, v);
+    return true;
+  }
+
+  /**
+   * @fn pwrite<T>
+   * @brief 在指定位置按小端格式写入一个值，定长记录文件中第i条记录的位置为i * DFRobot_Codec<T>::size
+   * @param offset 写入位置，不能超过文件大小
+   * @param v 要写入的值
+   * @return Returns the size in bytes written, 写入不完整时返回0
+   */
+  template<typename T>
+  size_t pwrite(uint32_t offset, const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    DFRobot_Codec<T>::encode(buf, v);
+    return (pwrite(offset, buf, sizeof(buf)) == sizeof(buf)) ? sizeof(buf) : 0;
+  }
+
+  /**
+   * @fn pread<T>
+   * @brief 在指定位置读出一个按小端格式写入的值
+   * @param offset 读取位置
+   * @param v 保存读出的值
+   * @return 读取结果
+   * @retval true  成功
+   * @retval false 剩余数据不足一个值或读取失败
+   */
+  template<typename T>
+  bool pread(uint32_t offset, T &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(pread(offset, buf, sizeof(buf)) != (int)sizeof(buf)) return false;
+    DFRobot_Codec<T>::decode(buf, v);
+    return true;
+  }
+  
+  /**
+   * @fn checksum
+   * @brief 计算文件指定范围的CRC-32，模块支持CMD_CRC32时只需一次命令，不用读回数据；否则读回数据计算
+   * @param crc    保存计算结果，与DFRobot_Crc32::update的结果相同
+   * @param offset 起始位置
+   * @param len    计算的字节数，默认计算到文件末尾
+   * @return 计算结果
+   * @retval true  成功
+   * @retval false 文件未打开或读取失败
+   */
+  bool checksum(uint32_t *crc, uint32_t offset = 0, uint32_t len = 0xFFFFFFFF);
+
+  /**
+   * @fn checksums
+   * @brief 计算从offset开始连续count块的CRC-32，模块支持CMD_CRC32和批处理命令时只需一次总线往返，用于与本地数据逐块比较
+   * @param crcs      保存每块的计算结果
+   * @param count     块数，超出文件末尾的块不计算
+   * @param blockSize 每块的字节数，最后一块超过文件末尾时只计算到文件末尾
+   * @param offset    第一块的起始位置
+   * @return 计算成功的块数，模块不支持CMD_CRC32时返回0(读回数据计算不比直接重写节省总线流量)
+   */
+  uint8_t checksums(uint32_t *crcs, uint8_t count, uint32_t blockSize, uint32_t offset = 0);
+
+  /**
+   * @fn syncFrom
+   * @brief 用src中len字节的新内容更新文件，只写入内容变化的块，适合重新下载大部分内容不变的配置和资源文件
+   * @details 每FLASH_SYNC_BLOCKS块(每块FLASH_COPY_BUF_SIZE字节)用一次总线往返查询模块上的CRC，
+   * @n 与从src读出的数据的CRC比较，不同的块用pwrite写入，相同的块不经过总线。模块不支持CMD_CRC32时所有块都写入。
+   * @n 结束后读写位置在len处，文件原来比len长时可调用close(true)截断多余的内容
+   * @param src     新内容，如Serial或另一个文件
+   * @param len     新内容的长度
+   * @param written 不为NULL时保存实际写入模块的字节数
+   * @return 更新结果
+   * @retval true  成功
+   * @retval false src数据不足、写入失败或文件不可读写
+   */
+  bool syncFrom(Stream &src, uint32_t len, uint32_t *written = NULL);
+
+  /**
+   * @fn startCrc
+   * @brief 从当前位置开始，在write/writev写出数据的同时计算CRC-32，用于写完后校验
+   * @n 只适合顺序写入，pwrite和seek后的写入不会被正确统计
+   */
+  void startCrc();
+
+  /**
+   * @fn crc
+   * @brief 获取startCrc之后写入数据的CRC-32
+   * @return CRC-32
+   */
+  uint32_t crc();
+
+  /**
+   * @fn verify
+   * @brief 校验startCrc之后写入的数据：让模块计算这段数据的CRC，与写入时计算的CRC比较，不需要读回数据
+   * @return 校验结果
+   * @retval true  一致
+   * @retval false 不一致、没有调用startCrc或计算失败
+   */
+  bool verify();
+
+  /**
+   * @fn copyTo
+   * @brief 从当前位置开始把文件内容整块复制到dst，每块只需一次读文件命令
+   * @n 使用两个缓存交替：dst支持availableForWrite()(如硬件串口)时，只把发送缓存放得下的部分交给dst，
+   * @n 在串口中断后台发送上一块的同时读取下一块；否则(如另一个DFRobot_File)按块阻塞写入
+   * @param dst 目标，任意Print，如串口或另一个模块上的DFRobot_File
+   * @param len 最多复制的字节数，默认复制到文件末尾
+   * @return 实际复制的字节数
+   */
+  uint32_t copyTo(Print &dst, uint32_t len = 0xFFFFFFFF);
+
+  /**
+   * @fn copyFrom
+   * @brief 从src读取数据写入文件当前位置，每凑满一块只需一次写文件命令
+   * @param src 数据来源，如Serial，src超时(setTimeout)未收到数据时结束
+   * @param len 最多复制的字节数，默认直到src超时
+   * @return 实际写入的字节数
+   */
+  uint32_t copyFrom(Stream &src, uint32_t len = 0xFFFFFFFF);
+
   /**
    * @fn peek
    * @brief Read 1 byte in file. Reads the value at the same position in the file.文件读指针不变
@@ -140,6 +463,15 @@ public:
    */
   boolean seek(uint32_t pos);
   
+  /**
+   * @fn reserve
+   * @brief Preallocate contiguous space for the file. 文件大小size()不变，以FILE_APPEND打开时仍从实际写入的末尾追加，
+   * @n 写入到预分配范围内时模块不再分配簇和更新FAT表，写入延时平稳。截断关闭(close(true))时释放未写入的预分配空间
+   * @param size 预分配后文件占用的总字节数
+   * @return true, is returned for success and false for failure or unsupported firmware.
+   */
+  boolean reserve(uint32_t size);
+
   /**
    * @fn position
    * @brief The current position for a file.
@@ -156,7 +488,8 @@ public:
   
   /**
    * @fn close
-   * @brief close the file or close and truncate the file.
+   * @brief close the file or close and truncate the file. 关闭后释放此对象对槽位的引用
+   * @n 不截断关闭文件时只同步数据，模块上的句柄暂留FLASH_WARM_FILES个，供下次open同一文件使用
    * @param truncate 在关闭时是否截断读写指针之后的内容
    * @n     false 不截断
    * @n     true  截断
@@ -205,6 +538,11 @@ private:
   DFRobot_FlashFile _root;
   friend class DFRobot_File;
   void getParentDir(const char *filepath, int *index);
+  DFRobot_File open(const char *filepath, uint8_t mode, bool knownFile);
+  static bool walkEntry(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg);
+  static bool tarExportEntry(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg);
+  boolean replaceSupported();
+  boolean replaceCommit(DFRobot_File &out, const char *tmp, const char *filepath, bool ok);
 public:
   /**
    * @fn DFRobot_FlashMoudle
@@ -239,6 +577,8 @@ public:
    * @n     FILE_APPEND 以追加的方式打开文件，打开后读写指针位置在文件末尾
    * @return 返回DFRobot_File类对象
    * @attention 注意根目录由系统打开，用户无法关闭它
+   * @n 刚关闭的文件以同样权限再次打开时直接使用暂留的句柄，不再发送打开命令；
+   * @n 模块句柄用完时换出最久未读写的文件，被换出的文件下次读写时自动重新打开并恢复读写位置
    */
   DFRobot_File open(const char *filepath, uint8_t mode = FILE_READ);
   DFRobot_File open(const String &filepath, uint8_t mode = FILE_READ) { return open( filepath.c_str(), mode ); }
@@ -258,6 +598,7 @@ public:
   /**
    * @fn mkdir
    * @brief 创建目录
+   * @details 相当于mkdir -p，路径中不存在的各级目录都会被创建，模块支持时只需一条命令
    * @param filepath 目录的绝对路径
    * @return 返回创建状态
    * @retval true 创建成功或该目录已经存在
@@ -289,10 +630,218 @@ public:
    */
   boolean rmdir(const char *filepath);
   boolean rmdir(const String &filepath) { return rmdir(filepath.c_str()); }
+
+  /**
+   * @fn append
+   * @brief 向文件末尾追加数据并关闭文件，文件不存在时创建
+   * @details 模块支持批处理命令时，打开、写入、同步、关闭只需一次总线往返，否则回退为4条单独的命令
+   * @param filepath 文件的绝对路径
+   * @param buf 指向要写入的数据的指针
+   * @param len 要写入的字节数
+   * @return 返回实际写入的字节数，失败返回0；数据写入后同步或关闭失败仍返回写入的字节数
+   */
+  uint16_t append(const char *filepath, const void *buf, uint16_t len);
+  uint16_t append(const char *filepath, const char *str) { return append(filepath, str, strlen(str)); }
+  uint16_t append(const String &filepath, const String &str) { return append(filepath.c_str(), str.c_str(), str.length()); }
+
+  /**
+   * @fn stat
+   * @brief 一次查询多个文件或目录的属性
+   * @details 模块支持批处理命令时只需一次总线往返，否则回退为逐个查询
+   * @param filepaths 文件或目录的绝对路径数组
+   * @param attrs 保存每个路径的属性
+   * @n     0  文件或目录不存在
+   * @n     1  这是一个文件
+   * @n     2~4 根目录
+   * @n     5  子目录
+   * @param num filepaths和attrs的元素个数
+   * @return 存在的文件或目录的个数
+   */
+  uint8_t stat(const char *const *filepaths, uint8_t *attrs, uint8_t num);
+
+  /**
+   * @fn removeTree
+   * @brief 递归移除目录及其下的所有文件和子目录，相当于rm -r
+   * @details 模块支持时只需一条命令，否则逐项遍历移除
+   * @param filepath 目录或文件的绝对路径。根目录为"/"，不可移除
+   * @return 返回移除状态
+   * @retval true 移除成功
+   * @retval false 移除失败
+   */
+  boolean removeTree(const char *filepath);
+  boolean removeTree(const String &filepath) { return removeTree(filepath.c_str()); }
+
+  /**
+   * @fn copy
+   * @brief 复制文件，目标文件已存在时先删除
+   * @param from 源文件的绝对路径
+   * @param to   目标文件的绝对路径
+   * @param dst  目标文件所在的模块，默认为本模块；两个模块设置不同的I2C地址后可以互相复制
+   * @return 复制结果
+   * @retval true  成功
+   * @retval false 打开文件失败、源和目标是本模块上的同一个文件或没有复制完整
+   */
+  boolean copy(const char *from, const char *to, DFRobot_FlashMoudle *dst = NULL);
+  boolean copy(const String &from, const String &to, DFRobot_FlashMoudle *dst = NULL) { return copy(from.c_str(), to.c_str(), dst); }
+
+  /**
+   * @fn rename
+   * @brief 重命名或移动文件、目录，只修改目录项，不复制数据
+   * @details 目标是已存在的文件时原子地替换它，掉电后看到的要么是旧文件要么是新文件；
+   * @n 模块不支持重命名命令时回退为复制后删除，此时不能移动目录，目标已存在时返回false
+   * @param from 原文件或目录的绝对路径
+   * @param to   新的绝对路径，所在目录必须已存在，不能是已存在的目录
+   * @return 重命名结果
+   * @retval true  成功
+   * @retval false 失败
+   * @attention 重命名前需关闭from下已打开的文件
+   */
+  boolean rename(const char *from, const char *to);
+  boolean rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+
+  /**
+   * @fn replace
+   * @brief 原子地替换文件内容：先写入同目录下扩展名为$$$的临时文件并校验，成功后重命名覆盖目标文件
+   * @n 写入过程中掉电或出错，目标文件保持原来的内容，适合配置、状态等不能只写一半的文件
+   * @param filepath 目标文件的绝对路径，不存在时创建
+   * @param buf      新的文件内容
+   * @param len      内容长度
+   * @return 替换结果
+   * @retval true  成功
+   * @retval false 写入、校验或重命名失败，临时文件已删除，目标文件未改变；模块不支持CMD_RENAME时直接返回false
+   */
+  boolean replace(const char *filepath, const void *buf, uint32_t len);
+  boolean replace(const String &filepath, const void *buf, uint32_t len) { return replace(filepath.c_str(), buf, len); }
+
+  /**
+   * @fn replace
+   * @brief 从src读取len字节，原子地替换文件内容
+   * @param filepath 目标文件的绝对路径
+   * @param src      数据来源，如串口
+   * @param len      内容长度，src在超时前提供的数据不足时替换失败
+   * @return 替换结果
+   */
+  boolean replace(const char *filepath, Stream &src, uint32_t len);
+  boolean replace(const String &filepath, Stream &src, uint32_t len) { return replace(filepath.c_str(), src, len); }
+
+  /**
+   * @fn walk
+   * @brief 深度优先遍历目录，每个文件和子目录调用一次回调函数，先访问目录本身再访问其下的目录项
+   * @param filepath 目录的绝对路径，根目录为"/"
+   * @param cb 回调函数，bool cb(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg)，返回false停止遍历
+   * @n     attr 1：文件 5：子目录
+   * @param arg 传给回调函数的用户参数
+   * @n 遍历时每一层目录占用一个模块句柄，不足时换出最久未用的文件，与打开文件时相同；回调函数中可以打开文件，
+   * @n 但遍历的目录层数加上同时打开的文件数不能超过模块可用的句柄数
+   * @return 返回遍历状态
+   * @retval true 遍历完成
+   * @retval false 遍历失败或被回调函数停止
+   */
+  boolean walk(const char *filepath, DFRobot_FlashWalkCallback cb, void *arg = NULL);
+  boolean walk(const String &filepath, DFRobot_FlashWalkCallback cb, void *arg = NULL) { return walk(filepath.c_str(), cb, arg); }
+
+  /**
+   * @fn exportTree
+   * @brief 把目录及其下的所有文件打包成tar(ustar)格式输出，电脑上可以直接用tar解包
+   * @details 文件名和大小来自walk的批量读目录结果，不再逐个查询；每个文件只需打开、整块读取和关闭，
+   * @n 包内路径相对于filepath，目录在其下的文件之前
+   * @param filepath 目录的绝对路径，根目录为"/"
+   * @param out 输出，任意Print，如Serial或另一个模块上的DFRobot_File
+   * @return 返回导出状态
+   * @retval true 导出完成
+   * @retval false 遍历或读文件失败，已输出的数据不是完整的tar包
+   */
+  boolean exportTree(const char *filepath, Print &out);
+  boolean exportTree(const String &filepath, Print &out) { return exportTree(filepath.c_str(), out); }
+
+  /**
+   * @fn importTree
+   * @brief 从in读取exportTree或电脑上tar命令生成的tar(ustar)包，把其中的目录和文件还原到filepath下
+   * @details 同名文件会被覆盖；链接等其他类型的项目被跳过。支持GNU的'L'和pax的path长路径，路径超过FLASH_PATH_MAX时失败。in超时(setTimeout)未收到数据时失败。
+   * @n 读到结束块后继续读掉后面补齐用的全0块，直到in超时，返回时tar包的数据已全部读出
+   * @param filepath 目标目录的绝对路径，根目录为"/"，不存在时创建
+   * @param in 输入，如Serial或另一个模块上的DFRobot_File
+   * @return 返回导入状态
+   * @retval true 读到tar包的结束块
+   * @retval false 数据不完整、校验和错误或写文件失败
+   */
+  boolean importTree(const char *filepath, Stream &in);
+  boolean importTree(const String &filepath, Stream &in) { return importTree(filepath.c_str(), in); }
+
+  /**
+   * @fn capacity
+   * @brief 获取磁盘容量
+   * @return 磁盘容量，单位字节
+   */
+  uint32_t capacity() { return _card.size(); }
+
+  /**
+   * @fn freeSpace
+   * @brief 获取磁盘空闲空间
+   * @details 由begin时的查询结果加上此后写入、截断的字节数在本地估算，不访问模块，适合在循环中调用；
+   * @n 移除文件、目录成功后会立即重新查询，释放的空间马上计入。可用setSpaceRefreshInterval设置自动刷新间隔
+   * @return 空闲空间，单位字节
+   */
+  uint32_t freeSpace() { return _card.freeSpace(); }
+
+  /**
+   * @fn usedSpace
+   * @brief 获取磁盘已用空间，估算方式同freeSpace
+   * @return 已用空间，单位字节
+   */
+  uint32_t usedSpace() { return _card.usedSpace(); }
+
+  /**
+   * @fn refreshSpace
+   * @brief 立即向模块查询空闲空间，修正本地估算值
+   * @return 返回刷新状态
+   * @retval true 刷新成功
+   * @retval false 刷新失败
+   */
+  boolean refreshSpace() { return _card.refreshSpace(); }
+
+  /**
+   * @fn setSpaceRefreshInterval
+   * @brief 设置freeSpace和usedSpace自动向模块查询空闲空间的间隔
+   * @param ms 刷新间隔，单位毫秒，0表示从不自动刷新(默认)
+   */
+  void setSpaceRefreshInterval(uint32_t ms) { _card.setSpaceRefreshInterval(ms); }
+
+  /**
+   * @fn closeIdleFiles
+   * @brief 关闭close后暂留的文件句柄，把模块句柄让给KVStore等直接打开文件的类
+   */
+  void closeIdleFiles() { DFRobot_File::closeIdle(this); }
+
+#if FLASH_THREAD_SAFE
+  /**
+   * @fn startDispatcher
+   * @brief 启动调度任务，多个任务(FreeRTOS任务或pthread线程)同时读写此模块上的文件时调用，begin之后调用一次即可
+   * @n 之后所有命令由调度任务独占通信接口依次执行，调用者阻塞到自己的命令完成；排队中的小写请求合并成一条命令发送
+   * @param stack    调度任务的栈大小，单位字节
+   * @param priority 调度任务的优先级
+   * @return 启动结果
+   * @retval true  启动成功或已经启动
+   * @retval false 创建任务失败
+   * @attention 调度任务保护与模块的通信，同时启用文件槽位表的锁，多个任务可以同时打开、关闭文件，句柄的换出和暂留也是互斥的；
+   * @n 同一个文件对象不能在多个任务中同时使用
+   */
+  boolean startDispatcher(uint32_t stack = FLASH_DISPATCHER_STACK, uint8_t priority = FLASH_DISPATCHER_PRIORITY) {
+    DFRobot_File::SlotLock::start();
+    return _card.startDispatcher(stack, priority);
+  }
+#endif
 private:
   friend class File;
 };
 
+#define IIC_CLOCK_AUTO      0   ///< begin传入此值时自动选择I2C通信频率
+#define IIC_PROBE_TIMES     16  ///< 自动选择频率时每个频率的校验次数
+#define IIC_PROBE_CONFIRM   256 ///< 自动选择频率时，通过的最高频率还要连续校验的次数，不通过就降低一档
+#define IIC_ERR_THRESHOLD   3   ///< 自动选择频率时，出错次数累计到此值降低一档频率
+#define IIC_ERR_DECAY       64  ///< 每连续成功通信这么多次，累计的出错次数减1
+#define FLASH_READY_PIN_NUM 2   ///< 最多同时使用就绪引脚的IIC对象个数，每个对象一个中断服务函数
+
 class DFRobot_FlashMoudle_IIC: public DFRobot_Driver{
 public:
   /**
@@ -310,13 +859,28 @@ public:
   /**
    * @fn begin
    * @brief IIC接口初始化
-   * @param freq I2C通信频率
+   * @param freq I2C通信频率，传入IIC_CLOCK_AUTO时自动选择通信频率：
+   * @n     从100kHz开始依次尝试400kHz、1MHz，每个频率连续IIC_PROBE_TIMES次读取IIC地址并校验，全部正确才算通过，
+   * @n     通过的最高频率再连续校验IIC_PROBE_CONFIRM次，全部正确才使用该频率，否则使用低一档的频率，
+   * @n     之后通信出错次数累计到IIC_ERR_THRESHOLD时，在当前这次传输结束(发送停止位或出错)后降低一档频率，用getClock获取当前使用的频率
    * @return 返回初始化状态
    * @retval 0 初始化成功
    * @retval 1 DFRobot_FlashMoudle_IIC构造中传入的pWire为NULL
    * @retval 2 设备未找到
    */
   uint8_t begin(uint32_t freq = 100000);
+  /**
+   * @fn getClock
+   * @brief 获取当前使用的I2C通信频率
+   * @return 通信频率，单位Hz
+   */
+  uint32_t getClock() { return _clock; }
+  /**
+   * @fn getErrorCount
+   * @brief 获取begin之后I2C通信出错的总次数
+   * @return 出错次数
+   */
+  uint32_t getErrorCount() { return _errTotal; }
 
   /**
    * @fn sendData
@@ -350,10 +914,35 @@ public:
    * @return None
    */
   virtual void flush();
+  /**
+   * @fn setReadyPin
+   * @brief 使用就绪引脚：模块的响应准备好时拉高就绪引脚，主控在上升沿中断中通知协议层，不再轮询响应状态字节
+   * @n 需要模块固件支持就绪引脚，并把就绪引脚连接到主控支持外部中断的引脚，最多FLASH_READY_PIN_NUM个IIC对象同时使用，各自连接不同的引脚
+   * @param pin 主控上连接就绪引脚的引脚号，小于0时关闭就绪模式
+   * @return 设置结果
+   * @retval true  成功
+   * @retval false 引脚已被其他IIC对象使用或对象个数已满，此对象回到轮询模式
+   */
+  bool setReadyPin(int pin);
 
 private:
+  template<uint8_t N> static void readyISR();
+  static void (* const _readyISR[FLASH_READY_PIN_NUM])();
+  static DFRobot_FlashMoudle_IIC *_readyDrv[FLASH_READY_PIN_NUM];
+  bool probe(uint16_t times);
+  void checkError(bool ok);
+  void applyClock();
   TwoWire *_pWire;
   uint8_t _addr;
+  int _readyPin;
+  uint32_t _clock;
+  bool _autoClock;
+  bool _clockPending;
+  bool _busOpen;
+  uint8_t _rateIdx;
+  uint8_t _errCount;
+  uint8_t _okCount;
+  uint32_t _errTotal;
 };
 
 
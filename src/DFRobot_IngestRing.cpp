@@ -0,0 +1,113 @@
+/*!
+ * @file DFRobot_IngestRing.cpp
+ * @brief DFRobot_IngestRing 类的实现
+ * @details 生产者先写数据再发布写位置，消费者先读写位置再读数据；AVR上关中断读写16/32位变量，
+ * @n 其他平台使用GCC的__atomic内建函数保证数据在位置更新之前可见
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#include "DFRobot_IngestRing.h"
+
+template<typename T>
+static inline T loadAcquire(volatile T *p){
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+  T v = *p;
+  SREG = sreg;
+  return v;
+#else
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+template<typename T>
+static inline void storeRelease(volatile T *p, T v){
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+  *p = v;
+  SREG = sreg;
+#else
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+DFRobot_IngestRing::DFRobot_IngestRing()
+  :_buf(NULL), _size(0), _head(0), _tail(0), _highWater(0), _overruns(0), _dropped(0){}
+
+bool DFRobot_IngestRing::begin(void *buf, uint16_t size){
+  if((buf == NULL) || (size < 2)) return false;
+  _buf = (uint8_t *)buf;
+  _size = size;
+  _head = _tail = 0;
+  resetStats();
+  return true;
+}
+
+bool FLASH_ISR_ATTR DFRobot_IngestRing::push(const void *data, uint16_t len){
+  if(_buf == NULL) return false;
+  uint16_t head = _head;
+  uint16_t tail = loadAcquire(&_tail);
+  uint16_t used = (head >= tail) ? (head - tail) : (_size - tail + head);
+  if(len > _size - 1 - used){
+    storeRelease(&_overruns, _overruns + 1);
+    storeRelease(&_dropped, _dropped + len);
+    return false;
+  }
+  //写到缓存末尾时分两段拷贝
+  uint16_t first = _size - head;
+  if(first > len) first = len;
+  memcpy(_buf + head, data, first);
+  memcpy(_buf, (const uint8_t *)data + first, len - first);
+  head += len;
+  if(head >= _size) head -= _size;
+  storeRelease(&_head, head);
+  used += len;
+  if(used > _highWater) storeRelease(&_highWater, used);
+  return true;
+}
+
+uint16_t DFRobot_IngestRing::available(void){
+  uint16_t head = loadAcquire(&_head);
+  uint16_t tail = _tail;
+  return (head >= tail) ? (head - tail) : (_size - tail + head);
+}
+
+uint16_t DFRobot_IngestRing::drain(DFRobot_File &file, uint16_t minBytes){
+  uint16_t n = available();
+  if((n == 0) || (n < minBytes)) return 0;
+  uint16_t tail = _tail;
+  uint16_t first = _size - tail;
+  if(first > n) first = n;
+  //回绕的数据作为第二段，两段在一个写文件命令中发送
+  sIoVec_t iov[2] = {{_buf + tail, first}, {_buf, (uint16_t)(n - first)}};
+  size_t w = file.writev(iov, iov[1].len ? 2 : 1);
+  if(w == 0) return 0;
+  tail += w;
+  if(tail >= _size) tail -= _size;
+  storeRelease(&_tail, tail);
+  return w;
+}
+
+uint32_t DFRobot_IngestRing::overruns(void){
+  return loadAcquire(&_overruns);
+}
+
+uint32_t DFRobot_IngestRing::droppedBytes(void){
+  return loadAcquire(&_dropped);
+}
+
+uint16_t DFRobot_IngestRing::highWater(void){
+  return loadAcquire(&_highWater);
+}
+
+void DFRobot_IngestRing::resetStats(void){
+  storeRelease(&_overruns, (uint32_t)0);
+  storeRelease(&_dropped, (uint32_t)0);
+  storeRelease(&_highWater, (uint16_t)0);
+}
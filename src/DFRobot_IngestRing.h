@@ -0,0 +1,128 @@
+/*!
+ * @file DFRobot_IngestRing.h
+ * @brief 定义 DFRobot_IngestRing 类 的基础结构
+ * @details DFRobot_IngestRing 是单生产者单消费者的无锁字节环形缓存：中断服务函数(或生产者线程)用push放入采样，
+ * @n loop()(或消费者线程)用drain把积累的数据一次写入DFRobot_File，环形缓存回绕时也只需一次写文件命令。
+ * @n push是全有或全无的，一条采样要么完整写入、要么整条丢弃并计入溢出计数，文件中的记录不会被截断。
+ * @n 生产者只修改写位置和溢出统计，消费者只修改读位置，双方不需要关中断或加锁；
+ * @n AVR上16位的位置不能一次读写，消费者一侧读写位置时短暂关中断
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#ifndef __DFRobot_INGESTRING_H
+#define __DFRobot_INGESTRING_H
+
+#include "DFRobot_Flash_Moudle.h"
+
+///< 放在中断服务函数中调用的函数的属性，ESP32/ESP8266上放入IRAM，写flash期间也能执行
+#ifndef FLASH_ISR_ATTR
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+#define FLASH_ISR_ATTR  IRAM_ATTR
+#else
+#define FLASH_ISR_ATTR
+#endif
+#endif
+
+class DFRobot_IngestRing{
+public:
+  /**
+   * @fn DFRobot_IngestRing
+   * @brief DFRobot_IngestRing类构造
+   */
+  DFRobot_IngestRing();
+
+  /**
+   * @fn begin
+   * @brief 使用调用者提供的缓存作为环形缓存，清空数据和统计
+   * @param buf  缓存，通常是全局数组
+   * @param size 缓存大小，单位字节，最多能存放size - 1字节
+   * @return 初始化结果
+   * @retval true  成功
+   * @retval false buf为空或size小于2
+   */
+  bool begin(void *buf, uint16_t size);
+
+  /**
+   * @fn push
+   * @brief 放入一条采样，可以在中断服务函数中调用(生产者)
+   * @param data 采样数据
+   * @param len  采样长度
+   * @return 放入结果
+   * @retval true  成功
+   * @retval false 剩余空间不足，整条丢弃，溢出计数加1
+   */
+  bool push(const void *data, uint16_t len);
+
+  /**
+   * @fn push<T>
+   * @brief 按DFRobot_Codec的小端格式放入一条采样，必须显式写出类型，例如ring.push<sSample_t>(s)
+   * @param v 采样
+   * @return 放入结果
+   */
+  template<typename T>
+  bool push(const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    DFRobot_Codec<T>::encode(buf, v);
+    return push(buf, sizeof(buf));
+  }
+
+  /**
+   * @fn available
+   * @brief 获取缓存中还未写入文件的字节数(消费者)
+   * @return 字节数
+   */
+  uint16_t available(void);
+
+  /**
+   * @fn drain
+   * @brief 把缓存中的数据用一次写文件命令写入文件当前位置(消费者)，数据不足minBytes时不写
+   * @n 写入期间生产者可以继续放入，新放入的数据留到下一次drain
+   * @param file     以FILE_WRITE或FILE_APPEND方式打开的文件
+   * @param minBytes 攒够这么多字节才写，用来把多条采样合并成一次大的写入
+   * @return 写入的字节数，没有写或写入失败时为0，未写入的数据仍留在缓存中
+   */
+  uint16_t drain(DFRobot_File &file, uint16_t minBytes = 1);
+
+  /**
+   * @fn overruns
+   * @brief 获取因缓存满而丢弃的采样条数
+   * @return 丢弃的条数
+   */
+  uint32_t overruns(void);
+
+  /**
+   * @fn droppedBytes
+   * @brief 获取因缓存满而丢弃的字节数
+   * @return 丢弃的字节数
+   */
+  uint32_t droppedBytes(void);
+
+  /**
+   * @fn highWater
+   * @brief 获取缓存占用的最大字节数，用来确定缓存大小和drain的间隔
+   * @return 最大占用字节数
+   */
+  uint16_t highWater(void);
+
+  /**
+   * @fn resetStats
+   * @brief 清零溢出计数和最大占用，只能在生产者不会同时调用push时调用(如关中断期间或生产者停止后)
+   */
+  void resetStats(void);
+
+private:
+  uint8_t *_buf;
+  uint16_t _size;
+  volatile uint16_t _head;       ///< 写位置，只由生产者修改
+  volatile uint16_t _tail;       ///< 读位置，只由消费者修改
+  volatile uint16_t _highWater;  ///< 最大占用字节数，只由生产者修改
+  volatile uint32_t _overruns;   ///< 丢弃的条数，只由生产者修改
+  volatile uint32_t _dropped;    ///< 丢弃的字节数，只由生产者修改
+};
+
+#endif
@@ -0,0 +1,372 @@
+/*!
+ * @file DFRobot_KVStore.cpp
+ * @brief 定义 DFRobot_KVStore 类 的实现
+ * @details 记录用writev一次追加，值用preadv一次定位读出，索引用线性探测的开放寻址哈希表
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_KVStore.h"
+
+#define KV_REC_MAGIC        0xB7
+#define KV_FLAG_TOMBSTONE   0x01
+#define KV_SLOT_DELETED     0xFF
+#define KV_SEG_BIT          0x80000000UL
+#define KV_SCAN_BUF_SIZE    64
+#define KV_COPY_BUF_SIZE    32
+
+#define KV_ENTRY_SEG(e)     (((e).off & KV_SEG_BIT) ? 1 : 0)
+#define KV_ENTRY_OFF(e)     ((e).off & ~KV_SEG_BIT)
+#define KV_REC_SIZE(klen, vlen)  ((uint32_t)KV_REC_HEADER_SIZE + (klen) + (vlen))
+
+static const uint8_t KV_SEG_MAGIC[4] = {'K', 'V', 'S', 1};
+
+static uint32_t kvHash(const char *key, uint8_t klen){
+  uint32_t h = 2166136261UL;  //FNV-1a
+  for(uint8_t i = 0; i < klen; i++){
+    h ^= (uint8_t)key[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+DFRobot_KVStore::DFRobot_KVStore()
+  :_flash(NULL), _gen(0), _active(0), _compacting(false), _compactPos(0),
+   _live(0), _garbage(0), _threshold(KV_COMPACT_MIN), _count(0), _keys(NULL){
+  _name[0] = '\0';
+  memset(_index, 0, sizeof(_index));
+}
+
+DFRobot_KVStore::~DFRobot_KVStore(){
+  if(_keys) free(_keys);
+}
+
+int DFRobot_KVStore::begin(DFRobot_FlashMoudle *flash, const char *name){
+  if((flash == NULL) || (name == NULL) || (strlen(name) == 0) || (strlen(name) > 8)) return 1;
+  _flash = flash;
+  strcpy(_name, name);
+  memset(_index, 0, sizeof(_index));
+  _live = _garbage = 0;
+  _count = 0;
+  _compacting = false;
+  if(_keys == NULL) _keys = (char (*)[KV_KEY_MAX_LEN])malloc(KV_INDEX_SIZE * KV_KEY_MAX_LEN);
+
+  uint32_t gen[2] = {0, 0};
+  bool has[2];
+  for(uint8_t i = 0; i < 2; i++){
+    char path[13];
+    segmentName(i, path);
+    has[i] = _flash->exists(path);
+    if(has[i] && !openSegment(i, &gen[i])) return 3;
+  }
+  if(!has[0] && !has[1]){
+    _active = 0;
+    _gen = 1;
+    return createSegment(0, _gen) ? 0 : 2;
+  }
+  if(has[0] && has[1]){
+    //两个段同时存在说明压缩被中断，先扫描旧段，新段中的记录更新，后扫描
+    uint8_t from = gen[0] < gen[1] ? 0 : 1;
+    _active = from ^ 1;
+    int32_t ret = scanSegment(from);
+    if(ret < 0) return -ret;
+    _compacting = true;
+    _compactPos = KV_SEG_HEADER_SIZE;
+  }else{
+    _active = has[0] ? 0 : 1;
+  }
+  _gen = gen[_active];
+  int32_t end = scanSegment(_active);
+  if(end < 0) return -end;
+  DFRobot_File &f = _seg[_active];
+  if((uint32_t)end < f.size()){
+    //截掉掉电时没有写完整的最后一条记录，否则之后追加的记录在下次扫描时会被跳过
+    char path[13];
+    segmentName(_active, path);
+    f.seek(end);
+    f.close(true);
+    f = _flash->open(path, FILE_WRITE);
+    if(!f) return 2;
+  }
+  f.seek(f.size());
+  return 0;
+}
+
+bool DFRobot_KVStore::put(const char *key, const void *value, uint16_t len){
+  if((_flash == NULL) || (key == NULL)) return false;
+  size_t klen = strlen(key);
+  if((klen == 0) || (klen > KV_KEY_MAX_LEN)) return false;
+  uint32_t h = kvHash(key, klen);
+  int16_t freeSlot;
+  int16_t slot = lookup(key, klen, h, NULL, 0, &freeSlot);
+  if((slot < 0) && (freeSlot < 0)) return false;
+  uint32_t off;
+  if(!writeRecord(0, key, klen, value, len, &off)) return false;
+  if(slot >= 0){
+    uint32_t old = KV_REC_SIZE(_index[slot].klen, _index[slot].vlen);
+    _live -= old;
+    _garbage += old;
+  }else{
+    slot = freeSlot;
+    _count++;
+  }
+  _index[slot].off = off | (_active ? KV_SEG_BIT : 0);
+  _index[slot].vlen = len;
+  _index[slot].tag = h >> 24;
+  _index[slot].klen = klen;
+  if(_keys) memcpy(_keys[slot], key, klen);
+  _live += KV_REC_SIZE(klen, len);
+  return true;
+}
+
+int32_t DFRobot_KVStore::get(const char *key, void *buf, uint16_t size){
+  if((_flash == NULL) || (key == NULL)) return -1;
+  size_t klen = strlen(key);
+  if((klen == 0) || (klen > KV_KEY_MAX_LEN)) return -1;
+  int16_t slot = lookup(key, klen, kvHash(key, klen), buf, size, NULL);
+  if(slot < 0) return -1;
+  return _index[slot].vlen;
+}
+
+bool DFRobot_KVStore::exists(const char *key){
+  if((_flash == NULL) || (key == NULL)) return false;
+  size_t klen = strlen(key);
+  if((klen == 0) || (klen > KV_KEY_MAX_LEN)) return false;
+  return lookup(key, klen, kvHash(key, klen), NULL, 0, NULL) >= 0;
+}
+
+bool DFRobot_KVStore::remove(const char *key){
+  if((_flash == NULL) || (key == NULL)) return false;
+  size_t klen = strlen(key);
+  if((klen == 0) || (klen > KV_KEY_MAX_LEN)) return false;
+  int16_t slot = lookup(key, klen, kvHash(key, klen), NULL, 0, NULL);
+  if(slot < 0) return false;
+  uint32_t off;
+  if(!writeRecord(KV_FLAG_TOMBSTONE, key, klen, NULL, 0, &off)) return false;
+  uint32_t old = KV_REC_SIZE(_index[slot].klen, _index[slot].vlen);
+  _live -= old;
+  _garbage += old + KV_REC_SIZE(klen, 0);
+  _index[slot].klen = KV_SLOT_DELETED;
+  _count--;
+  return true;
+}
+
+bool DFRobot_KVStore::sync(void){
+  if(_flash == NULL) return false;
+  _seg[_active].flush();
+  return true;
+}
+
+bool DFRobot_KVStore::poll(void){
+  if(_flash == NULL) return false;
+  if(!_compacting){
+    if((_garbage <= _threshold) || (_garbage <= _live)) return false;
+    if(!startCompact()) return false;
+  }
+  compactStep();
+  return _compacting;
+}
+
+bool DFRobot_KVStore::compact(void){
+  if(_flash == NULL) return false;
+  if(!_compacting && !startCompact()) return false;
+  while(_compacting){
+    if(!compactStep()) return false;
+  }
+  return true;
+}
+
+int16_t DFRobot_KVStore::lookup(const char *key, uint8_t klen, uint32_t h, void *buf, uint16_t size, int16_t *freeSlot){
+  uint8_t tag = h >> 24;
+  uint16_t mask = KV_INDEX_SIZE - 1;
+  if(freeSlot) *freeSlot = -1;
+  for(uint16_t i = 0; i < KV_INDEX_SIZE; i++){
+    uint16_t idx = (h + i) & mask;
+    sKVEntry_t &e = _index[idx];
+    if(e.klen == 0){
+      if(freeSlot && (*freeSlot < 0)) *freeSlot = idx;
+      return -1;
+    }
+    if(e.klen == KV_SLOT_DELETED){
+      if(freeSlot && (*freeSlot < 0)) *freeSlot = idx;
+      continue;
+    }
+    if((e.klen != klen) || (e.tag != tag)) continue;
+    uint16_t n = (buf == NULL) ? 0 : (e.vlen > size ? size : e.vlen);
+    if(_keys){
+      if(memcmp(_keys[idx], key, klen)) continue;
+      if(n && (_seg[KV_ENTRY_SEG(e)].pread(KV_ENTRY_OFF(e) + KV_REC_HEADER_SIZE + klen, buf, n) != (int)n)) return -1;
+      return idx;
+    }
+    //没有键缓存时从段文件读出键比较，get时键和值用一次定位读同时读出
+    char kb[KV_KEY_MAX_LEN];
+    sIoVec_t iov[2] = {{kb, klen}, {buf, n}};
+    if(_seg[KV_ENTRY_SEG(e)].preadv(KV_ENTRY_OFF(e) + KV_REC_HEADER_SIZE, iov, n ? 2 : 1) != (int)(klen + n)) continue;
+    if(memcmp(kb, key, klen) == 0) return idx;
+  }
+  return -1;
+}
+
+bool DFRobot_KVStore::applyRecord(uint8_t seg, uint32_t off, uint8_t flags, const char *key, uint8_t klen, uint16_t vlen){
+  uint32_t h = kvHash(key, klen);
+  int16_t freeSlot;
+  int16_t slot = lookup(key, klen, h, NULL, 0, &freeSlot);
+  if(slot >= 0){
+    uint32_t old = KV_REC_SIZE(_index[slot].klen, _index[slot].vlen);
+    _live -= old;
+    _garbage += old;
+  }
+  if(flags & KV_FLAG_TOMBSTONE){
+    _garbage += KV_REC_SIZE(klen, 0);
+    if(slot >= 0){
+      _index[slot].klen = KV_SLOT_DELETED;
+      _count--;
+    }
+    return true;
+  }
+  if(slot < 0){
+    if(freeSlot < 0) return false;
+    slot = freeSlot;
+    _count++;
+  }
+  _index[slot].off = off | (seg ? KV_SEG_BIT : 0);
+  _index[slot].vlen = vlen;
+  _index[slot].tag = h >> 24;
+  _index[slot].klen = klen;
+  if(_keys) memcpy(_keys[slot], key, klen);
+  _live += KV_REC_SIZE(klen, vlen);
+  return true;
+}
+
+bool DFRobot_KVStore::writeRecord(uint8_t flags, const char *key, uint8_t klen, const void *value, uint16_t vlen, uint32_t *off){
+  DFRobot_File &f = _seg[_active];
+  uint8_t hdr[KV_REC_HEADER_SIZE] = {KV_REC_MAGIC, flags, klen, (uint8_t)(vlen & 0xFF), (uint8_t)(vlen >> 8)};
+  sIoVec_t iov[3] = {{hdr, sizeof(hdr)}, {(void *)key, klen}, {(void *)value, vlen}};
+  *off = f.position();
+  if(f.writev(iov, vlen ? 3 : 2) != KV_REC_SIZE(klen, vlen)){
+    f.seek(*off);
+    return false;
+  }
+  return true;
+}
+
+int32_t DFRobot_KVStore::scanSegment(uint8_t seg){
+  DFRobot_File &f = _seg[seg];
+  uint32_t size = f.size();
+  uint32_t pos = KV_SEG_HEADER_SIZE;
+  uint8_t buf[KV_SCAN_BUF_SIZE];
+  uint32_t bufOff = 0;
+  uint16_t bufLen = 0;
+  //按块顺序读，每块可能包含多条记录的头部和键，值被跳过
+  while(pos + KV_REC_HEADER_SIZE <= size){
+    uint32_t need = KV_REC_HEADER_SIZE + KV_KEY_MAX_LEN;
+    if(need > size - pos) need = size - pos;
+    if((pos < bufOff) || (pos + need > bufOff + bufLen)){
+      uint16_t n = (size - pos) > sizeof(buf) ? sizeof(buf) : (uint16_t)(size - pos);
+      if(f.pread(pos, buf, n) != (int)n) return -3;
+      bufOff = pos;
+      bufLen = n;
+    }
+    uint8_t *p = buf + (pos - bufOff);
+    uint8_t klen = p[2];
+    uint16_t vlen = p[3] | (p[4] << 8);
+    if((p[0] != KV_REC_MAGIC) || (klen == 0) || (klen > KV_KEY_MAX_LEN)) break;
+    if(pos + KV_REC_SIZE(klen, vlen) > size) break;
+    if(!applyRecord(seg, pos, p[1], (const char *)p + KV_REC_HEADER_SIZE, klen, vlen)) return -4;
+    pos += KV_REC_SIZE(klen, vlen);
+  }
+  return (int32_t)pos;
+}
+
+bool DFRobot_KVStore::openSegment(uint8_t seg, uint32_t *gen){
+  char path[13];
+  segmentName(seg, path);
+  _seg[seg] = _flash->open(path, FILE_WRITE);
+  if(!_seg[seg]) return false;
+  uint8_t hdr[KV_SEG_HEADER_SIZE];
+  if(_seg[seg].pread(0, hdr, sizeof(hdr)) != (int)sizeof(hdr)) return false;
+  if(memcmp(hdr, KV_SEG_MAGIC, sizeof(KV_SEG_MAGIC))) return false;
+  *gen = (uint32_t)hdr[4] | ((uint32_t)hdr[5] << 8) | ((uint32_t)hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+  return true;
+}
+
+bool DFRobot_KVStore::createSegment(uint8_t seg, uint32_t gen){
+  char path[13];
+  segmentName(seg, path);
+  if(_flash->exists(path)) _flash->remove(path);
+  _seg[seg] = _flash->open(path, FILE_WRITE);
+  if(!_seg[seg]) return false;
+  uint8_t hdr[KV_SEG_HEADER_SIZE];
+  memcpy(hdr, KV_SEG_MAGIC, sizeof(KV_SEG_MAGIC));
+  hdr[4] = gen & 0xFF;
+  hdr[5] = (gen >> 8) & 0xFF;
+  hdr[6] = (gen >> 16) & 0xFF;
+  hdr[7] = (gen >> 24) & 0xFF;
+  if(_seg[seg].write(hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+  _seg[seg].flush();
+  return true;
+}
+
+bool DFRobot_KVStore::startCompact(void){
+  if(!createSegment(_active ^ 1, _gen + 1)) return false;
+  _active ^= 1;
+  _gen++;
+  _compacting = true;
+  _compactPos = KV_SEG_HEADER_SIZE;
+  return true;
+}
+
+bool DFRobot_KVStore::compactStep(void){
+  uint8_t from = _active ^ 1;
+  DFRobot_File &src = _seg[from];
+  DFRobot_File &dst = _seg[_active];
+  uint32_t size = src.size();
+  if(_compactPos + KV_REC_HEADER_SIZE <= size){
+    uint8_t buf[KV_REC_HEADER_SIZE + KV_KEY_MAX_LEN];
+    uint16_t n = (size - _compactPos) > sizeof(buf) ? sizeof(buf) : (uint16_t)(size - _compactPos);
+    if(src.pread(_compactPos, buf, n) != (int)n) return false;
+    uint8_t klen = buf[2];
+    uint16_t vlen = buf[3] | (buf[4] << 8);
+    if((buf[0] == KV_REC_MAGIC) && (klen > 0) && (klen <= KV_KEY_MAX_LEN) && (_compactPos + KV_REC_SIZE(klen, vlen) <= size)){
+      //只有索引仍指向这条记录时它才是有效记录，不需要读键比较
+      uint32_t target = _compactPos | (from ? KV_SEG_BIT : 0);
+      for(uint16_t i = 0; i < KV_INDEX_SIZE; i++){
+        sKVEntry_t &e = _index[i];
+        if((e.klen == 0) || (e.klen == KV_SLOT_DELETED) || (e.off != target)) continue;
+        uint32_t off = dst.position();
+        if(dst.write(buf, KV_REC_HEADER_SIZE + klen) != (size_t)(KV_REC_HEADER_SIZE + klen)) return false;
+        uint8_t chunk[KV_COPY_BUF_SIZE];
+        uint32_t pos = _compactPos + KV_REC_HEADER_SIZE + klen;
+        for(uint16_t left = vlen; left; ){
+          uint16_t c = left > sizeof(chunk) ? sizeof(chunk) : left;
+          if(src.pread(pos, chunk, c) != (int)c) return false;
+          if(dst.write(chunk, c) != c) return false;
+          pos += c;
+          left -= c;
+        }
+        e.off = off | (_active ? KV_SEG_BIT : 0);
+        break;
+      }
+      _compactPos += KV_REC_SIZE(klen, vlen);
+      return true;
+    }
+  }
+  //旧段复制完，删除旧段
+  char path[13];
+  segmentName(from, path);
+  dst.flush();
+  src.close();
+  _flash->remove(path);
+  _compacting = false;
+  _garbage = dst.size() - KV_SEG_HEADER_SIZE - _live;
+  return true;
+}
+
+void DFRobot_KVStore::segmentName(uint8_t seg, char *path){
+  strcpy(path, _name);
+  strcat(path, seg ? ".KV1" : ".KV0");
+}
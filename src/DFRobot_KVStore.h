@@ -0,0 +1,208 @@
+/*!
+ * @file DFRobot_KVStore.h
+ * @brief 定义 DFRobot_KVStore 类 的基础结构
+ * @details DFRobot_KVStore 是建立在DFRobot_FlashMoudle上的日志结构键值存储，所有修改都追加到段文件末尾
+ * @n 段文件：<name>.KV0 和 <name>.KV1，同一时刻通常只存在一个，压缩时新旧两个段同时存在
+ * @n 段头部：魔数"KVS"(3) + 版本(1) + 代数(4，小端)，代数大的段较新
+ * @n 记录：魔数(1) + 标志(1) + 键长度(1) + 值长度(2，小端) + 键 + 值，标志bit0为删除标记(墓碑)
+ * @n 内存中的哈希索引保存每个键最新记录的位置、值长度、键长度和8位哈希标签，键本身保存在begin时申请的键缓存中，
+ * @n 键缓存申请失败时比较键需要从段文件读出
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#ifndef __DFRobot_KVSTORE_H
+#define __DFRobot_KVSTORE_H
+
+#include "DFRobot_Flash_Moudle.h"
+
+#define KV_KEY_MAX_LEN       15    ///< 键的最大长度
+#define KV_SEG_HEADER_SIZE   8     ///< 段头部大小
+#define KV_REC_HEADER_SIZE   5     ///< 记录头部大小
+#define KV_COMPACT_MIN       1024  ///< 默认的压缩阈值，垃圾字节数超过此值且超过有效字节数时开始压缩
+
+#ifndef KV_INDEX_SIZE
+#if defined(__AVR__)
+#define KV_INDEX_SIZE        16    ///< 索引槽位数，必须是2的幂，最多能保存的键个数与此相同
+#else
+#define KV_INDEX_SIZE        64
+#endif
+#endif
+
+class DFRobot_KVStore{
+public:
+  /**
+   * @fn DFRobot_KVStore
+   * @brief DFRobot_KVStore类构造
+   */
+  DFRobot_KVStore();
+  ~DFRobot_KVStore();
+
+  /**
+   * @fn begin
+   * @brief 键值存储初始化，顺序扫描段文件重建内存索引，上次压缩被中断时会继续压缩
+   * @param flash DFRobot_FlashMoudle类对象指针，需已初始化
+   * @param name  段文件名，不带扩展名，最多8个字符，例如"CONFIG"对应CONFIG.KV0和CONFIG.KV1
+   * @return 初始化结果
+   * @retval 0   初始化成功
+   * @retval 1   flash为空或name不合法
+   * @retval 2   打开或创建段文件失败
+   * @retval 3   读取段文件失败
+   * @retval 4   键的个数超过KV_INDEX_SIZE
+   */
+  int begin(DFRobot_FlashMoudle *flash, const char *name);
+
+  /**
+   * @fn put
+   * @brief 写入或更新一个键，记录追加到段文件末尾，只需一次写文件命令，调用sync后才保证写入flash
+   * @param key   键，以'\0'结尾，长度1~KV_KEY_MAX_LEN
+   * @param value 值
+   * @param len   值的长度
+   * @return 写入结果
+   * @retval true  成功
+   * @retval false 键不合法、索引已满或写入失败
+   */
+  bool put(const char *key, const void *value, uint16_t len);
+
+  /**
+   * @fn get
+   * @brief 读取一个键的值，通常只需一次定位读命令
+   * @param key  键
+   * @param buf  保存值
+   * @param size buf的大小，值比buf长时只读取前size个字节
+   * @return 值的完整长度，键不存在或读取失败时返回-1
+   */
+  int32_t get(const char *key, void *buf, uint16_t size);
+
+  /**
+   * @fn put<T>
+   * @brief 按DFRobot_Codec的小端格式写入一个值，必须显式写出类型，例如kv.put<uint32_t>("BOOTS", n)
+   * @param key 键
+   * @param v   值
+   * @return 写入结果
+   */
+  template<typename T>
+  bool put(const char *key, const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    DFRobot_Codec<T>::encode(buf, v);
+    return put(key, buf, sizeof(buf));
+  }
+
+  /**
+   * @fn get<T>
+   * @brief 读取并解码一个用put<T>写入的值
+   * @param key 键
+   * @param v   保存值
+   * @return 读取结果
+   * @retval true  成功
+   * @retval false 键不存在、值的长度与类型不符或读取失败
+   */
+  template<typename T>
+  bool get(const char *key, T &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(get(key, buf, sizeof(buf)) != (int32_t)sizeof(buf)) return false;
+    DFRobot_Codec<T>::decode(buf, v);
+    return true;
+  }
+
+  /**
+   * @fn exists
+   * @brief 判断键是否存在
+   * @param key 键
+   * @return 判断结果
+   * @retval true  存在
+   * @retval false 不存在
+   */
+  bool exists(const char *key);
+
+  /**
+   * @fn remove
+   * @brief 删除一个键，追加一条删除标记记录
+   * @param key 键
+   * @return 删除结果
+   * @retval true  成功
+   * @retval false 键不存在或写入失败
+   */
+  bool remove(const char *key);
+
+  /**
+   * @fn sync
+   * @brief 把已追加的记录同步到flash
+   * @return 同步结果
+   */
+  bool sync(void);
+
+  /**
+   * @fn poll
+   * @brief 后台压缩，在loop中周期调用。垃圾字节数超过阈值时开始压缩，每次调用只把一条有效记录复制到新段
+   * @n 压缩期间put、get、remove照常使用，新记录直接写入新段，复制完成后删除旧段
+   * @return 调用后是否仍在压缩
+   */
+  bool poll(void);
+
+  /**
+   * @fn compact
+   * @brief 立即压缩，直到复制完所有有效记录后才返回
+   * @return 压缩结果
+   */
+  bool compact(void);
+
+  /**
+   * @fn setCompactThreshold
+   * @brief 设置poll开始压缩的垃圾字节数阈值，默认KV_COMPACT_MIN
+   * @param bytes 阈值，单位字节
+   */
+  void setCompactThreshold(uint32_t bytes) { _threshold = bytes; }
+
+  /**
+   * @fn count
+   * @brief 获取键的个数
+   * @return 键的个数
+   */
+  uint16_t count(void) { return _count; }
+
+  /**
+   * @fn garbageBytes
+   * @brief 获取已被覆盖或删除的记录占用的字节数，压缩后回收
+   * @return 垃圾字节数
+   */
+  uint32_t garbageBytes(void) { return _garbage; }
+
+protected:
+  typedef struct{
+    uint32_t off;   ///< 记录在段文件中的位置，bit31为段文件编号
+    uint16_t vlen;  ///< 值长度
+    uint8_t  tag;   ///< 8位哈希标签
+    uint8_t  klen;  ///< 键长度，0表示空槽位，0xFF表示已删除
+  }sKVEntry_t;
+
+  int16_t lookup(const char *key, uint8_t klen, uint32_t h, void *buf, uint16_t size, int16_t *freeSlot);
+  bool applyRecord(uint8_t seg, uint32_t off, uint8_t flags, const char *key, uint8_t klen, uint16_t vlen);
+  bool writeRecord(uint8_t flags, const char *key, uint8_t klen, const void *value, uint16_t vlen, uint32_t *off);
+  int32_t scanSegment(uint8_t seg);
+  bool openSegment(uint8_t seg, uint32_t *gen);
+  bool createSegment(uint8_t seg, uint32_t gen);
+  bool startCompact(void);
+  bool compactStep(void);
+  void segmentName(uint8_t seg, char *path);
+
+private:
+  DFRobot_FlashMoudle *_flash;
+  char _name[9];
+  DFRobot_File _seg[2];
+  uint32_t _gen;
+  uint8_t _active;
+  bool _compacting;
+  uint32_t _compactPos;
+  uint32_t _live;
+  uint32_t _garbage;
+  uint32_t _threshold;
+  uint16_t _count;
+  sKVEntry_t _index[KV_INDEX_SIZE];
+  char (*_keys)[KV_KEY_MAX_LEN];
+};
+#endif
@@ -0,0 +1,131 @@
+/*!
+ * @file DFRobot_RingLog.cpp
+ * @brief 定义 DFRobot_RingLog 类 的实现
+ * @details 头部块和记录都用DFRobot_File的pread/pwrite定位读写，不移动文件读写指针
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_RingLog.h"
+
+static const uint8_t RINGLOG_MAGIC[4] = {'R', 'L', 'O', 'G'};
+
+static void put32(uint8_t *p, uint32_t v){
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t get32(const uint8_t *p){
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+DFRobot_RingLog::DFRobot_RingLog()
+  :_file(NULL), _capacity(0), _head(0), _used(0), _count(0), _readPos(0), _readLeft(0){}
+
+int DFRobot_RingLog::begin(DFRobot_File *file, uint32_t capacity){
+  _file = file;
+  if(!_file || !(*_file)) return 1;
+  if(capacity <= RINGLOG_RECORD_HEAD) return 2;
+  if(_file->size() == 0){
+    _capacity = capacity;
+    _head = _used = _count = 0;
+    //预分配失败(模块不支持)不影响使用，只是第一次写满数据区前写入时有分配簇的延时
+    _file->reserve(RINGLOG_HEADER_SIZE + capacity);
+    if(!writeHeader()) return 3;
+    rewind();
+    return 0;
+  }
+  uint8_t hdr[RINGLOG_HEADER_SIZE];
+  if(_file->pread(0, hdr, sizeof(hdr)) != (int)sizeof(hdr)) return 3;
+  if(memcmp(hdr, RINGLOG_MAGIC, sizeof(RINGLOG_MAGIC)) || (get32(hdr + 4) != capacity)) return 4;
+  _capacity = capacity;
+  _head = get32(hdr + 8);
+  _used = get32(hdr + 12);
+  _count = get32(hdr + 16);
+  if((_head >= _capacity) || (_used > _capacity)) return 3;
+  rewind();
+  return 0;
+}
+
+bool DFRobot_RingLog::append(const void *data, uint16_t len){
+  if(!_file) return false;
+  uint32_t need = (uint32_t)len + RINGLOG_RECORD_HEAD;
+  if(need > _capacity) return false;
+  //丢弃最旧的记录直到放得下，每条记录只会被丢弃一次，均摊到每次追加是常数次读
+  bool evicted = false;
+  while(_used + need > _capacity){
+    uint8_t lb[RINGLOG_RECORD_HEAD];
+    if(!readData(_head, lb, sizeof(lb))) return false;
+    uint32_t rlen = RINGLOG_RECORD_HEAD + (lb[0] | (lb[1] << 8));
+    _head = (_head + rlen) % _capacity;
+    _used -= rlen;
+    _count--;
+    evicted = true;
+  }
+  //先保存丢弃后的头部再覆盖旧记录，掉电时头部不会指向被覆盖了一半的数据
+  if(evicted && !writeHeader()) return false;
+  uint8_t lb[RINGLOG_RECORD_HEAD] = {(uint8_t)(len & 0xFF), (uint8_t)(len >> 8)};
+  uint32_t tail = (_head + _used) % _capacity;
+  if(!writeData(tail, lb, sizeof(lb))) return false;
+  if(!writeData((tail + RINGLOG_RECORD_HEAD) % _capacity, data, len)) return false;
+  _used += need;
+  _count++;
+  return writeHeader();
+}
+
+bool DFRobot_RingLog::clear(void){
+  if(!_file) return false;
+  _head = _used = _count = 0;
+  rewind();
+  return writeHeader();
+}
+
+void DFRobot_RingLog::rewind(void){
+  _readPos = _head;
+  _readLeft = _count;
+}
+
+int32_t DFRobot_RingLog::readNext(void *buf, uint16_t size){
+  if(!_file || (_readLeft == 0)) return -1;
+  uint8_t lb[RINGLOG_RECORD_HEAD];
+  if(!readData(_readPos, lb, sizeof(lb))) return -1;
+  uint16_t len = lb[0] | (lb[1] << 8);
+  uint16_t n = len > size ? size : len;
+  if(n && !readData((_readPos + RINGLOG_RECORD_HEAD) % _capacity, buf, n)) return -1;
+  _readPos = (_readPos + RINGLOG_RECORD_HEAD + len) % _capacity;
+  _readLeft--;
+  return len;
+}
+
+bool DFRobot_RingLog::writeHeader(void){
+  uint8_t hdr[RINGLOG_HEADER_SIZE];
+  memcpy(hdr, RINGLOG_MAGIC, sizeof(RINGLOG_MAGIC));
+  put32(hdr + 4, _capacity);
+  put32(hdr + 8, _head);
+  put32(hdr + 12, _used);
+  put32(hdr + 16, _count);
+  return _file->pwrite(0, hdr, sizeof(hdr)) == sizeof(hdr);
+}
+
+bool DFRobot_RingLog::writeData(uint32_t pos, const void *data, uint16_t len){
+  const uint8_t *p = (const uint8_t *)data;
+  //跨过数据区末尾时分两段写
+  uint16_t first = (_capacity - pos) < len ? (uint16_t)(_capacity - pos) : len;
+  if(first && (_file->pwrite(RINGLOG_HEADER_SIZE + pos, p, first) != first)) return false;
+  if((len > first) && (_file->pwrite(RINGLOG_HEADER_SIZE, p + first, len - first) != (size_t)(len - first))) return false;
+  return true;
+}
+
+bool DFRobot_RingLog::readData(uint32_t pos, void *data, uint16_t len){
+  uint8_t *p = (uint8_t *)data;
+  uint16_t first = (_capacity - pos) < len ? (uint16_t)(_capacity - pos) : len;
+  if(first && (_file->pread(RINGLOG_HEADER_SIZE + pos, p, first) != (int)first)) return false;
+  if((len > first) && (_file->pread(RINGLOG_HEADER_SIZE, p + first, len - first) != (int)(len - first))) return false;
+  return true;
+}
@@ -0,0 +1,146 @@
+/*!
+ * @file DFRobot_RingLog.h
+ * @brief 定义 DFRobot_RingLog 类 的基础结构
+ * @details DFRobot_RingLog 在一个预分配的DFRobot_File上实现固定大小的循环日志，写满后覆盖最旧的记录
+ * @n 文件布局：头部块(RINGLOG_HEADER_SIZE字节) + 数据区(capacity字节)
+ * @n 头部块：魔数"RLOG"(4) + 数据区大小(4) + 最旧记录位置head(4) + 已用字节数(4) + 记录条数(4)，小端
+ * @n 记录：数据长度(2，小端) + 数据，记录可以跨过数据区末尾回绕到数据区开头
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#ifndef __DFRobot_RINGLOG_H
+#define __DFRobot_RINGLOG_H
+
+#include "DFRobot_Flash_Moudle.h"
+
+#define RINGLOG_HEADER_SIZE   20   ///< 头部块大小
+#define RINGLOG_RECORD_HEAD   2    ///< 每条记录的长度字段大小
+
+class DFRobot_RingLog{
+public:
+  /**
+   * @fn DFRobot_RingLog
+   * @brief DFRobot_RingLog类构造
+   */
+  DFRobot_RingLog();
+
+  /**
+   * @fn begin
+   * @brief 循环日志初始化，空文件会被格式化并预分配头部块和数据区，已有的循环日志文件会载入头部块继续使用
+   * @param file     DFRobot_File类对象指针，需以FILE_WRITE方式打开
+   * @param capacity 数据区大小，单位字节，文件最终占用RINGLOG_HEADER_SIZE + capacity字节
+   * @return 初始化结果
+   * @retval 0   初始化成功
+   * @retval 1   file为空或未打开
+   * @retval 2   capacity太小
+   * @retval 3   读写头部块失败
+   * @retval 4   文件不是循环日志，或数据区大小与capacity不一致
+   */
+  int begin(DFRobot_File *file, uint32_t capacity);
+
+  /**
+   * @fn append
+   * @brief 追加一条记录，数据区剩余空间不足时丢弃最旧的记录
+   * @n 每次追加写一次记录(跨过数据区末尾时为两次)和一次头部块，不改变文件大小，不删除或重建文件；
+   * @n 需要丢弃旧记录时先写一次丢弃后的头部块再覆盖旧数据，任何时刻掉电头部块都只指向完整的记录
+   * @param data 记录数据
+   * @param len  记录长度，不能超过capacity - RINGLOG_RECORD_HEAD
+   * @return 追加结果
+   * @retval true  追加成功
+   * @retval false 记录太长或写入失败
+   */
+  bool append(const void *data, uint16_t len);
+
+  /**
+   * @fn append<T>
+   * @brief 按DFRobot_Codec的小端格式追加一条记录，必须显式写出类型，例如log.append<sEvent_t>(e)
+   * @param v 记录
+   * @return 追加结果
+   */
+  template<typename T>
+  bool append(const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    DFRobot_Codec<T>::encode(buf, v);
+    return append(buf, sizeof(buf));
+  }
+
+  /**
+   * @fn clear
+   * @brief 清空所有记录，只改写头部块
+   * @return 清空结果
+   * @retval true  成功
+   * @retval false 写头部块失败
+   */
+  bool clear(void);
+
+  /**
+   * @fn rewind
+   * @brief 把读记录的位置移到最旧的一条记录，append之后需重新调用
+   */
+  void rewind(void);
+
+  /**
+   * @fn readNext
+   * @brief 按从旧到新的顺序读取下一条记录
+   * @param buf  保存记录数据
+   * @param size buf的大小，记录比buf长时只读取前size个字节
+   * @return 记录的完整长度，没有更多记录或读取失败时返回-1
+   */
+  int32_t readNext(void *buf, uint16_t size);
+
+  /**
+   * @fn readNext<T>
+   * @brief 读取并解码下一条用append<T>写入的记录
+   * @param v 保存记录
+   * @return 读取结果
+   * @retval true  成功
+   * @retval false 没有更多记录、记录长度与类型不符或读取失败
+   */
+  template<typename T>
+  bool readNext(T &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(readNext(buf, sizeof(buf)) != (int32_t)sizeof(buf)) return false;
+    DFRobot_Codec<T>::decode(buf, v);
+    return true;
+  }
+
+  /**
+   * @fn count
+   * @brief 获取当前保存的记录条数
+   * @return 记录条数
+   */
+  uint32_t count(void) { return _count; }
+
+  /**
+   * @fn usedBytes
+   * @brief 获取数据区已用字节数，包括每条记录的长度字段
+   * @return 已用字节数
+   */
+  uint32_t usedBytes(void) { return _used; }
+
+  /**
+   * @fn capacity
+   * @brief 获取数据区大小
+   * @return 数据区大小，单位字节
+   */
+  uint32_t capacity(void) { return _capacity; }
+
+protected:
+  bool writeHeader(void);
+  bool writeData(uint32_t pos, const void *data, uint16_t len);
+  bool readData(uint32_t pos, void *data, uint16_t len);
+private:
+  DFRobot_File *_file;
+  uint32_t _capacity;
+  uint32_t _head;
+  uint32_t _used;
+  uint32_t _count;
+  uint32_t _readPos;
+  uint32_t _readLeft;
+};
+#endif
@@ -0,0 +1,283 @@
+/*!
+ * @file DFRobot_StagedFile.cpp
+ * @brief DFRobot_StagedFile 类的实现
+ * @details 应用和工作任务共用一把锁保护读写位置和计数，复制数据和读写文件都在锁外进行；
+ * @n 工作任务只在暂存数据达到写入阈值、有flush请求、同步时间到或要停止时才写文件，其余时间阻塞等待
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#include "DFRobot_StagedFile.h"
+
+#if FLASH_THREAD_SAFE
+
+DFRobot_StagedFile::DFRobot_StagedFile()
+  :_file(NULL), _buf(NULL), _size(0), _chunk(0), _head(0), _tail(0), _syncMs(0), _base(0),
+   _staged(0), _drained(0), _synced(0), _flushTarget(0), _since(0),
+   _running(false), _stop(false), _exited(false), _error(false){}
+
+DFRobot_StagedFile::~DFRobot_StagedFile(){
+  close();
+}
+
+bool DFRobot_StagedFile::begin(DFRobot_File *file, void *buf, uint16_t size, uint32_t syncMs){
+  if(_running || (file == NULL) || !*file || (buf == NULL) || (size < 2)) return false;
+  _file = file;
+  _buf = (uint8_t *)buf;
+  _size = size;
+  _chunk = (FLASH_STAGE_CHUNK < size / 2) ? FLASH_STAGE_CHUNK : size / 2;
+  _head = _tail = 0;
+  _syncMs = syncMs;
+  _base = file->position();
+  _staged = _drained = _synced = _flushTarget = 0;
+  _stop = _exited = _error = false;
+#if defined(ARDUINO_ARCH_ESP32)
+  _lock = xSemaphoreCreateMutexStatic(&_lockBuf);
+  _progress = xSemaphoreCreateBinaryStatic(&_progressBuf);
+  if(xTaskCreatePinnedToCore(entry, "flashw", FLASH_DISPATCHER_STACK, this, FLASH_DISPATCHER_PRIORITY, &_task, FLASH_STAGE_CORE) != pdPASS){
+    vSemaphoreDelete(_progress);
+    vSemaphoreDelete(_lock);
+    return false;
+  }
+#else
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_wake, NULL);
+  pthread_cond_init(&_progress, NULL);
+  if(pthread_create(&_thread, NULL, entry, this) != 0){
+    pthread_cond_destroy(&_progress);
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_lock);
+    return false;
+  }
+#endif
+  _running = true;
+  return true;
+}
+
+size_t DFRobot_StagedFile::write(uint8_t val){
+  return write(&val, 1);
+}
+
+size_t DFRobot_StagedFile::write(const uint8_t *buf, size_t size){
+  if(!_running) return 0;
+  size_t done = 0;
+  lock();
+  while((done < size) && !_error){
+    uint16_t space = _size - 1 - used();
+    if(space == 0){
+      //缓存满，等待工作任务写出一部分
+      wakeWorker();
+      waitApp();
+      continue;
+    }
+    uint16_t n = (size - done < space) ? (size - done) : space;
+    uint16_t head = _head;
+    unlock();
+    //只有应用修改写位置，复制期间工作任务只会读走head之前的数据
+    uint16_t first = _size - head;
+    if(first > n) first = n;
+    memcpy(_buf + head, buf + done, first);
+    memcpy(_buf, buf + done + first, n - first);
+    head += n;
+    if(head >= _size) head -= _size;
+    lock();
+    if(_staged == _synced) _since = millis();
+    _head = head;
+    _staged += n;
+    done += n;
+    if(used() >= _chunk) wakeWorker();
+  }
+  unlock();
+  return done;
+}
+
+void DFRobot_StagedFile::flush(){
+  sync();
+}
+
+bool DFRobot_StagedFile::sync(void){
+  if(!_running) return false;
+  lock();
+  bool ret = waitSynced(_staged);
+  unlock();
+  return ret;
+}
+
+bool DFRobot_StagedFile::waitSynced(uint32_t target){
+  if(target > _flushTarget) _flushTarget = target;
+  wakeWorker();
+  while(!_error && (_synced < target)) waitApp();
+  return !_error;
+}
+
+bool DFRobot_StagedFile::close(void){
+  if(!_running) return false;
+  lock();
+  bool ret = waitSynced(_staged);
+  _stop = true;
+  wakeWorker();
+  while(!_exited) waitApp();
+  unlock();
+#if defined(ARDUINO_ARCH_ESP32)
+  vSemaphoreDelete(_progress);
+  vSemaphoreDelete(_lock);
+#else
+  pthread_join(_thread, NULL);
+  pthread_cond_destroy(&_progress);
+  pthread_cond_destroy(&_wake);
+  pthread_mutex_destroy(&_lock);
+#endif
+  _running = false;
+  _file->close();
+  return ret;
+}
+
+uint32_t DFRobot_StagedFile::size(void){
+  if(!_running) return 0;
+  lock();
+  uint32_t pos = _base + _staged;
+  unlock();
+  //工作任务可能正在写入，文件大小只读缓存中的值，不发送命令
+  uint32_t fileSize = _file->size();
+  return (pos > fileSize) ? pos : fileSize;
+}
+
+uint32_t DFRobot_StagedFile::pending(void){
+  if(!_running) return 0;
+  lock();
+  uint32_t n = _staged - _synced;
+  unlock();
+  return n;
+}
+
+DFRobot_StagedFile::operator bool(){
+  return _running && !_error;
+}
+
+void DFRobot_StagedFile::loop(){
+  lock();
+  while(!_error){
+    uint16_t n = used();
+    uint32_t elapsed = millis() - _since;
+    bool due = _syncMs && (_staged > _synced) && (elapsed >= _syncMs);
+    bool flushing = _flushTarget > _synced;
+    if((_drained > _synced) && ((flushing && (_drained >= _flushTarget)) || due || (_stop && !n))){
+      //同步已写入文件的数据，期间应用可以继续写入暂存缓存
+      uint32_t drained = _drained;
+      unlock();
+      _file->flush();
+      lock();
+      _synced = drained;
+      if(_staged > _synced) _since = millis();
+      notifyApp();
+    }else if(n && ((n >= _chunk) || flushing || due || _stop)){
+      //暂存的数据可能回绕，两段用一次写文件命令写入
+      uint16_t tail = _tail;
+      uint16_t first = _size - tail;
+      if(first > n) first = n;
+      sIoVec_t iov[2] = {{_buf + tail, first}, {_buf, (uint16_t)(n - first)}};
+      unlock();
+      size_t w = _file->writev(iov, iov[1].len ? 2 : 1);
+      lock();
+      if(w != n) _error = true;
+      tail += w;
+      if(tail >= _size) tail -= _size;
+      _tail = tail;
+      _drained += w;
+      notifyApp();
+    }else if(_stop){
+      break;
+    }else{
+      waitWorker((_syncMs && (_staged > _synced)) ? (_syncMs - elapsed) : 0);
+    }
+  }
+  _exited = true;
+  notifyApp();
+  unlock();
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+void DFRobot_StagedFile::entry(void *p){
+  ((DFRobot_StagedFile *)p)->loop();
+  vTaskDelete(NULL);
+}
+
+void DFRobot_StagedFile::lock(){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+}
+
+void DFRobot_StagedFile::unlock(){
+  xSemaphoreGive(_lock);
+}
+
+void DFRobot_StagedFile::wakeWorker(){
+  xTaskNotifyGive(_task);
+}
+
+void DFRobot_StagedFile::waitWorker(uint32_t ms){
+  unlock();
+  ulTaskNotifyTake(pdTRUE, ms ? pdMS_TO_TICKS(ms) : portMAX_DELAY);
+  lock();
+}
+
+void DFRobot_StagedFile::notifyApp(){
+  xSemaphoreGive(_progress);
+}
+
+void DFRobot_StagedFile::waitApp(){
+  //信号量在解锁和等待之间被释放也会保留，不会漏掉通知
+  unlock();
+  xSemaphoreTake(_progress, portMAX_DELAY);
+  lock();
+}
+
+#else
+
+void *DFRobot_StagedFile::entry(void *p){
+  ((DFRobot_StagedFile *)p)->loop();
+  return NULL;
+}
+
+void DFRobot_StagedFile::lock(){
+  pthread_mutex_lock(&_lock);
+}
+
+void DFRobot_StagedFile::unlock(){
+  pthread_mutex_unlock(&_lock);
+}
+
+void DFRobot_StagedFile::wakeWorker(){
+  pthread_cond_signal(&_wake);
+}
+
+void DFRobot_StagedFile::waitWorker(uint32_t ms){
+  if(ms == 0){
+    pthread_cond_wait(&_wake, &_lock);
+    return;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000L;
+  if(ts.tv_nsec >= 1000000000L){
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_cond_timedwait(&_wake, &_lock, &ts);
+}
+
+void DFRobot_StagedFile::notifyApp(){
+  pthread_cond_broadcast(&_progress);
+}
+
+void DFRobot_StagedFile::waitApp(){
+  pthread_cond_wait(&_progress, &_lock);
+}
+
+#endif
+
+#endif
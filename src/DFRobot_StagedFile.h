@@ -0,0 +1,158 @@
+/*!
+ * @file DFRobot_StagedFile.h
+ * @brief 定义 DFRobot_StagedFile 类 的基础结构
+ * @details DFRobot_StagedFile 把flash写入完全移到后台工作任务：应用用print/write写入内存中的暂存缓存，立即返回；
+ * @n 工作任务(ESP32上固定在另一个核，Linux主机上是pthread线程)攒够FLASH_STAGE_CHUNK字节后用一次写文件命令写入，
+ * @n 并在数据暂存超过syncMs毫秒后同步到flash。flush()只阻塞到工作任务确认之前写入的数据已同步。
+ * @n 只支持一个应用任务写入，写入和flush/close需在同一个任务中调用
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#ifndef __DFRobot_STAGEDFILE_H
+#define __DFRobot_STAGEDFILE_H
+
+#include "DFRobot_Flash_Moudle.h"
+
+#if FLASH_THREAD_SAFE
+
+#ifndef FLASH_STAGE_CHUNK
+#define FLASH_STAGE_CHUNK    512   ///< 暂存数据达到这么多字节时工作任务开始写入，超过缓存的一半时按缓存的一半计算
+#endif
+#ifndef FLASH_STAGE_SYNC_MS
+#define FLASH_STAGE_SYNC_MS  1000  ///< 默认的同步间隔，数据暂存超过这么多毫秒后写入并同步到flash
+#endif
+#ifndef FLASH_STAGE_CORE
+#define FLASH_STAGE_CORE     0     ///< ESP32上工作任务所在的核，Arduino的loop运行在核1
+#endif
+
+class DFRobot_StagedFile : public Print{
+public:
+  /**
+   * @fn DFRobot_StagedFile
+   * @brief DFRobot_StagedFile类构造
+   */
+  DFRobot_StagedFile();
+  ~DFRobot_StagedFile();
+
+  /**
+   * @fn begin
+   * @brief 启动工作任务，之后的写入先放入暂存缓存，由工作任务写入file
+   * @param file   以FILE_WRITE或FILE_APPEND方式打开的文件，close之前只能由工作任务使用
+   * @param buf    暂存缓存，通常是全局数组
+   * @param size   缓存大小，单位字节
+   * @param syncMs 同步间隔，单位毫秒，0表示只在flush和close时同步
+   * @return 启动结果
+   * @retval true  成功
+   * @retval false 参数不合法、文件未打开、已经启动或创建任务失败
+   * @attention 工作任务使用文件期间，其他任务如果也要操作模块，需先调用flash.startDispatcher()
+   */
+  bool begin(DFRobot_File *file, void *buf, uint16_t size, uint32_t syncMs = FLASH_STAGE_SYNC_MS);
+
+  /**
+   * @fn write
+   * @brief 写入一个字节到暂存缓存
+   * @param val 要写入的字节
+   * @return 写入的字节数，出错时为0
+   */
+  virtual size_t write(uint8_t val);
+
+  /**
+   * @fn write
+   * @brief 把数据复制到暂存缓存后立即返回，只在缓存满时等待工作任务腾出空间
+   * @param buf  要写入的数据
+   * @param size 数据长度
+   * @return 写入的字节数，工作任务写文件出错后为0
+   */
+  virtual size_t write(const uint8_t *buf, size_t size);
+  using Print::write;
+
+  /**
+   * @fn flush
+   * @brief 阻塞到之前写入的数据全部写入文件并同步到flash
+   */
+  virtual void flush();
+
+  /**
+   * @fn sync
+   * @brief 与flush相同，返回同步结果
+   * @return 同步结果
+   * @retval true  成功
+   * @retval false 工作任务写文件出错，或没有启动
+   */
+  bool sync(void);
+
+  /**
+   * @fn close
+   * @brief 同步数据，停止工作任务并关闭文件
+   * @return 同步结果
+   */
+  bool close(void);
+
+  /**
+   * @fn size
+   * @brief 获取文件大小，包括还在暂存缓存中的数据
+   * @return 文件大小，单位字节
+   */
+  uint32_t size(void);
+
+  /**
+   * @fn pending
+   * @brief 获取已写入但还未同步到flash的字节数
+   * @return 字节数
+   */
+  uint32_t pending(void);
+
+  operator bool();
+
+private:
+  void loop();
+  bool waitSynced(uint32_t target);
+  uint16_t used() { return (_head >= _tail) ? (_head - _tail) : (_size - _tail + _head); }
+
+  void lock();
+  void unlock();
+  void wakeWorker();
+  void waitWorker(uint32_t ms);
+  void notifyApp();
+  void waitApp();
+#if defined(ARDUINO_ARCH_ESP32)
+  static void entry(void *p);
+  TaskHandle_t _task;
+  SemaphoreHandle_t _lock;
+  StaticSemaphore_t _lockBuf;
+  SemaphoreHandle_t _progress;
+  StaticSemaphore_t _progressBuf;
+#else
+  static void *entry(void *p);
+  pthread_t _thread;
+  pthread_mutex_t _lock;
+  pthread_cond_t _wake;      ///< 有新数据或flush请求，唤醒工作任务
+  pthread_cond_t _progress;  ///< 工作任务写入或同步了数据
+#endif
+  DFRobot_File *_file;
+  uint8_t *_buf;
+  uint16_t _size;
+  uint16_t _chunk;
+  uint16_t _head;        ///< 写位置，只由应用修改
+  uint16_t _tail;        ///< 读位置，只由工作任务修改
+  uint32_t _syncMs;
+  uint32_t _base;        ///< begin时的文件大小
+  uint32_t _staged;      ///< 应用写入的总字节数
+  uint32_t _drained;     ///< 已写入文件的总字节数
+  uint32_t _synced;      ///< 已同步到flash的总字节数
+  uint32_t _flushTarget; ///< flush要求同步到的位置
+  uint32_t _since;       ///< 最早一个未同步字节写入的时间
+  bool _running;
+  bool _stop;
+  bool _exited;
+  bool _error;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+/*!
+ * @file DFRobot_TimeLog.cpp
+ * @brief 定义 DFRobot_TimeLog 类 的实现
+ * @details 追加记录用writev从文件末尾顺序写，块头和查询用pread/pwrite定位读写
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#include "DFRobot_TimeLog.h"
+
+static const uint8_t TIMELOG_MAGIC[4] = {'T', 'L', 'O', 'G'};
+static const uint8_t TIMELOG_BLOCK_MAGIC[2] = {'T', 'B'};
+
+static void put16(uint8_t *p, uint16_t v){
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+static void put32(uint8_t *p, uint32_t v){
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+static uint16_t get16(const uint8_t *p){
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p){
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+DFRobot_TimeLog::DFRobot_TimeLog()
+  :_file(NULL), _recordSize(0), _perBlock(0), _blocks(0), _blockCount(0), _blockFirst(0),
+   _records(0), _firstTs(0), _lastTs(0), _readBlock(0), _readIdx(0){}
+
+int DFRobot_TimeLog::begin(DFRobot_File *file, uint16_t recordSize, uint16_t recordsPerBlock){
+  _file = file;
+  if(!_file || !(*_file)) return 1;
+  if((recordSize == 0) || (recordsPerBlock == 0)) return 2;
+  _recordSize = recordSize;
+  _perBlock = recordsPerBlock;
+  _blocks = _records = 0;
+  _blockCount = 0;
+  _firstTs = _lastTs = 0;
+  rewind();
+
+  uint8_t hdr[TIMELOG_FILE_HEADER_SIZE];
+  uint32_t size = _file->size();
+  if(size == 0){
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, TIMELOG_MAGIC, sizeof(TIMELOG_MAGIC));
+    put16(hdr + 4, _recordSize);
+    put16(hdr + 6, _perBlock);
+    if(_file->write(hdr, sizeof(hdr)) != sizeof(hdr)) return 3;
+    return 0;
+  }
+  if(_file->pread(0, hdr, sizeof(hdr)) != (int)sizeof(hdr)) return 3;
+  if(memcmp(hdr, TIMELOG_MAGIC, sizeof(TIMELOG_MAGIC)) || (get16(hdr + 4) != _recordSize) || (get16(hdr + 6) != _perBlock)) return 4;
+
+  //由文件大小找到最后一个块，块头不完整或没有完整记录的块视为空块，之后的追加会覆盖它
+  uint32_t blockBytes = blockOffset(1) - blockOffset(0);
+  uint32_t n = (size - TIMELOG_FILE_HEADER_SIZE + blockBytes - 1) / blockBytes;
+  uint16_t cnt = 0;
+  uint32_t first = 0, last = 0;
+  bool sealed = true;
+  while(n && (!blockInfo(n - 1, &cnt, &first, &last, &sealed) || (cnt == 0))) n--;
+  if(n){
+    if(cnt == _perBlock){
+      //块已写满但掉电前没来得及写块头
+      if(!sealed) sealBlock(n - 1, first, last);
+      _blocks = n;
+    }else{
+      _blocks = n - 1;
+      _blockCount = cnt;
+      _blockFirst = first;
+    }
+    _records = _blocks * _perBlock + _blockCount;
+    _lastTs = last;
+    if(!blockInfo(0, &cnt, &_firstTs, &last, &sealed)) return 3;
+  }
+  uint32_t end = blockOffset(_blocks) + (_blockCount ? (TIMELOG_BLOCK_HEADER_SIZE + (uint32_t)_blockCount * (TIMELOG_TS_SIZE + _recordSize)) : 0);
+  if(!_file->seek(end)) return 3;
+  return 0;
+}
+
+bool DFRobot_TimeLog::append(uint32_t timestamp, const void *data){
+  if(!_file || (_recordSize == 0)) return false;
+  if(_records && (timestamp < _lastTs)) return false;
+  uint8_t bh[TIMELOG_BLOCK_HEADER_SIZE];
+  uint8_t tsb[TIMELOG_TS_SIZE];
+  put32(tsb, timestamp);
+  size_t want = TIMELOG_TS_SIZE + _recordSize;
+  size_t ret;
+  if(_blockCount == 0){
+    //新块的块头和第一条记录一起写，记录条数在块写满时再写入
+    memcpy(bh, TIMELOG_BLOCK_MAGIC, sizeof(TIMELOG_BLOCK_MAGIC));
+    put16(bh + 2, 0);
+    put32(bh + 4, timestamp);
+    put32(bh + 8, timestamp);
+    sIoVec_t iov[3] = {{bh, sizeof(bh)}, {tsb, sizeof(tsb)}, {(void *)data, _recordSize}};
+    want += sizeof(bh);
+    ret = _file->writev(iov, 3);
+    _blockFirst = timestamp;
+  }else{
+    sIoVec_t iov[2] = {{tsb, sizeof(tsb)}, {(void *)data, _recordSize}};
+    ret = _file->writev(iov, 2);
+  }
+  if(ret != want){
+    _file->seek(blockOffset(_blocks) + (_blockCount ? (TIMELOG_BLOCK_HEADER_SIZE + (uint32_t)_blockCount * (TIMELOG_TS_SIZE + _recordSize)) : 0));
+    return false;
+  }
+  if(_records == 0) _firstTs = timestamp;
+  _records++;
+  _lastTs = timestamp;
+  if(++_blockCount == _perBlock){
+    sealBlock(_blocks, _blockFirst, timestamp);
+    _blocks++;
+    _blockCount = 0;
+  }
+  return true;
+}
+
+bool DFRobot_TimeLog::seekTime(uint32_t timestamp){
+  if(!_file) return false;
+  uint32_t n = numBlocks();
+  uint32_t lo = 0, hi = n;
+  //找第一个最后时间戳不小于timestamp的块
+  while(lo < hi){
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t last = _lastTs;
+    if(mid < _blocks){
+      uint16_t cnt;
+      uint32_t first;
+      bool sealed;
+      if(!blockInfo(mid, &cnt, &first, &last, &sealed)) break;
+    }
+    if(last < timestamp) lo = mid + 1;
+    else hi = mid;
+  }
+  if(lo >= n){
+    _readBlock = n;
+    _readIdx = 0;
+    return false;
+  }
+  //块内同样二分查找
+  uint16_t l = 0, h = blockCount(lo) - 1;
+  while(l < h){
+    uint16_t m = l + (h - l) / 2;
+    uint32_t ts;
+    if(!readTime(lo, m, &ts)) return false;
+    if(ts < timestamp) l = m + 1;
+    else h = m;
+  }
+  _readBlock = lo;
+  _readIdx = l;
+  return true;
+}
+
+void DFRobot_TimeLog::rewind(void){
+  _readBlock = 0;
+  _readIdx = 0;
+}
+
+bool DFRobot_TimeLog::readNext(uint32_t *timestamp, void *data){
+  if(!_file) return false;
+  uint32_t n = numBlocks();
+  while((_readBlock < n) && (_readIdx >= blockCount(_readBlock))){
+    _readBlock++;
+    _readIdx = 0;
+  }
+  if(_readBlock >= n) return false;
+  uint8_t tsb[TIMELOG_TS_SIZE];
+  sIoVec_t iov[2] = {{tsb, sizeof(tsb)}, {data, _recordSize}};
+  uint32_t off = blockOffset(_readBlock) + TIMELOG_BLOCK_HEADER_SIZE + (uint32_t)_readIdx * (TIMELOG_TS_SIZE + _recordSize);
+  if(_file->preadv(off, iov, 2) != (int)(TIMELOG_TS_SIZE + _recordSize)) return false;
+  if(timestamp) *timestamp = get32(tsb);
+  _readIdx++;
+  return true;
+}
+
+bool DFRobot_TimeLog::blockInfo(uint32_t block, uint16_t *count, uint32_t *first, uint32_t *last, bool *sealed){
+  uint8_t bh[TIMELOG_BLOCK_HEADER_SIZE];
+  uint32_t off = blockOffset(block);
+  if(_file->pread(off, bh, sizeof(bh)) != (int)sizeof(bh)) return false;
+  if(memcmp(bh, TIMELOG_BLOCK_MAGIC, sizeof(TIMELOG_BLOCK_MAGIC))) return false;
+  *count = get16(bh + 2);
+  *first = get32(bh + 4);
+  *last = get32(bh + 8);
+  *sealed = (*count == _perBlock);
+  if(*sealed) return true;
+  //未写满的块由文件大小计算记录条数，读最后一条记录的时间戳
+  uint32_t size = _file->size();
+  uint32_t avail = (size > off + TIMELOG_BLOCK_HEADER_SIZE) ? (size - off - TIMELOG_BLOCK_HEADER_SIZE) : 0;
+  avail /= (TIMELOG_TS_SIZE + _recordSize);
+  *count = avail > _perBlock ? _perBlock : (uint16_t)avail;
+  if(*count == 0) return true;
+  return readTime(block, *count - 1, last);
+}
+
+bool DFRobot_TimeLog::readTime(uint32_t block, uint16_t idx, uint32_t *timestamp){
+  uint8_t tsb[TIMELOG_TS_SIZE];
+  uint32_t off = blockOffset(block) + TIMELOG_BLOCK_HEADER_SIZE + (uint32_t)idx * (TIMELOG_TS_SIZE + _recordSize);
+  if(_file->pread(off, tsb, sizeof(tsb)) != (int)sizeof(tsb)) return false;
+  *timestamp = get32(tsb);
+  return true;
+}
+
+bool DFRobot_TimeLog::sealBlock(uint32_t block, uint32_t first, uint32_t last){
+  uint8_t bh[TIMELOG_BLOCK_HEADER_SIZE];
+  memcpy(bh, TIMELOG_BLOCK_MAGIC, sizeof(TIMELOG_BLOCK_MAGIC));
+  put16(bh + 2, _perBlock);
+  put32(bh + 4, first);
+  put32(bh + 8, last);
+  return _file->pwrite(blockOffset(block), bh, sizeof(bh)) == sizeof(bh);
+}
+
+uint32_t DFRobot_TimeLog::blockOffset(uint32_t block){
+  return TIMELOG_FILE_HEADER_SIZE + block * (TIMELOG_BLOCK_HEADER_SIZE + (uint32_t)_perBlock * (TIMELOG_TS_SIZE + _recordSize));
+}
+
+uint32_t DFRobot_TimeLog::numBlocks(void){
+  return _blocks + (_blockCount ? 1 : 0);
+}
+
+uint16_t DFRobot_TimeLog::blockCount(uint32_t block){
+  return (block < _blocks) ? _perBlock : _blockCount;
+}
@@ -0,0 +1,160 @@
+/*!
+ * @file DFRobot_TimeLog.h
+ * @brief 定义 DFRobot_TimeLog 类 的基础结构
+ * @details DFRobot_TimeLog 按时间戳顺序把定长记录写入一个DFRobot_File，记录按块组织，块头保存块内第一条和最后一条记录的时间戳，
+ * @n 按时间范围查询时先对块做二分查找，只需O(log n)次定位读，然后只读取范围内的记录
+ * @n 文件布局：文件头(TIMELOG_FILE_HEADER_SIZE字节) + 块0 + 块1 + ...
+ * @n 文件头：魔数"TLOG"(4) + 记录数据长度(2) + 每块记录条数(2) + 保留(4)，小端
+ * @n 块：块头(TIMELOG_BLOCK_HEADER_SIZE字节) + 记录 * 每块记录条数，最后一个块可能未写满
+ * @n 块头：魔数"TB"(2) + 记录条数(2) + 第一条记录的时间戳(4) + 最后一条记录的时间戳(4)，块写满时才写入记录条数和最后的时间戳
+ * @n 记录：时间戳(4，小端) + 数据
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-05-06
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+
+#ifndef __DFRobot_TIMELOG_H
+#define __DFRobot_TIMELOG_H
+
+#include "DFRobot_Flash_Moudle.h"
+
+#define TIMELOG_FILE_HEADER_SIZE   12  ///< 文件头大小
+#define TIMELOG_BLOCK_HEADER_SIZE  12  ///< 块头大小
+#define TIMELOG_TS_SIZE            4   ///< 每条记录的时间戳大小
+
+class DFRobot_TimeLog{
+public:
+  /**
+   * @fn DFRobot_TimeLog
+   * @brief DFRobot_TimeLog类构造
+   */
+  DFRobot_TimeLog();
+
+  /**
+   * @fn begin
+   * @brief 时间日志初始化，空文件会写入文件头，已有的时间日志文件会找到最后一条完整的记录继续追加
+   * @param file            DFRobot_File类对象指针，写入时需以FILE_WRITE方式打开，只查询时可以FILE_READ方式打开
+   * @param recordSize      每条记录的数据长度，不包括时间戳
+   * @param recordsPerBlock 每块记录条数
+   * @return 初始化结果
+   * @retval 0   初始化成功
+   * @retval 1   file为空或未打开
+   * @retval 2   recordSize或recordsPerBlock为0
+   * @retval 3   读写文件失败
+   * @retval 4   文件不是时间日志，或记录长度、每块记录条数与文件不一致
+   */
+  int begin(DFRobot_File *file, uint16_t recordSize, uint16_t recordsPerBlock = 32);
+
+  /**
+   * @fn append
+   * @brief 追加一条记录，每条记录只需一次写文件命令，块写满时多一次写块头
+   * @param timestamp 时间戳，不能小于上一条记录的时间戳
+   * @param data      记录数据，长度为recordSize
+   * @return 追加结果
+   * @retval true  成功
+   * @retval false 时间戳倒退或写入失败
+   */
+  bool append(uint32_t timestamp, const void *data);
+
+  /**
+   * @fn append<T>
+   * @brief 按DFRobot_Codec的小端格式追加一条记录，DFRobot_Codec<T>::size须等于recordSize
+   * @n 必须显式写出类型，例如log.append<sSample_t>(ts, s)
+   * @param timestamp 时间戳
+   * @param v         记录
+   * @return 追加结果
+   */
+  template<typename T>
+  bool append(uint32_t timestamp, const typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(sizeof(buf) != _recordSize) return false;
+    DFRobot_Codec<T>::encode(buf, v);
+    return append(timestamp, buf);
+  }
+
+  /**
+   * @fn seekTime
+   * @brief 把读记录的位置移到第一条时间戳大于等于timestamp的记录，对块和块内记录做二分查找
+   * @param timestamp 时间戳
+   * @return 是否存在这样的记录
+   */
+  bool seekTime(uint32_t timestamp);
+
+  /**
+   * @fn rewind
+   * @brief 把读记录的位置移到第一条记录
+   */
+  void rewind(void);
+
+  /**
+   * @fn readNext
+   * @brief 按时间顺序读取下一条记录
+   * @param timestamp 保存记录的时间戳
+   * @param data      保存记录数据，大小至少为recordSize
+   * @return 成功返回true，没有更多记录或读取失败返回false
+   */
+  bool readNext(uint32_t *timestamp, void *data);
+
+  /**
+   * @fn readNext<T>
+   * @brief 读取并解码下一条记录，同样必须显式写出类型，例如log.readNext<sSample_t>(&ts, s)，
+   * @n 否则会和readNext(uint32_t *, void *)混淆
+   * @param timestamp 保存记录的时间戳
+   * @param v         保存记录
+   * @return 成功返回true，没有更多记录、记录长度与类型不符或读取失败返回false
+   */
+  template<typename T>
+  bool readNext(uint32_t *timestamp, typename DFRobot_CodecArg<T>::type &v){
+    uint8_t buf[DFRobot_Codec<T>::size];
+    if(sizeof(buf) != _recordSize) return false;
+    if(!readNext(timestamp, buf)) return false;
+    DFRobot_Codec<T>::decode(buf, v);
+    return true;
+  }
+
+  /**
+   * @fn count
+   * @brief 获取记录条数
+   * @return 记录条数
+   */
+  uint32_t count(void) { return _records; }
+
+  /**
+   * @fn firstTime
+   * @brief 获取第一条记录的时间戳
+   * @return 时间戳，没有记录时返回0
+   */
+  uint32_t firstTime(void) { return _firstTs; }
+
+  /**
+   * @fn lastTime
+   * @brief 获取最后一条记录的时间戳
+   * @return 时间戳，没有记录时返回0
+   */
+  uint32_t lastTime(void) { return _lastTs; }
+
+protected:
+  bool blockInfo(uint32_t block, uint16_t *count, uint32_t *first, uint32_t *last, bool *sealed);
+  bool readTime(uint32_t block, uint16_t idx, uint32_t *timestamp);
+  bool sealBlock(uint32_t block, uint32_t first, uint32_t last);
+  uint32_t blockOffset(uint32_t block);
+  uint32_t numBlocks(void);
+  uint16_t blockCount(uint32_t block);
+
+private:
+  DFRobot_File *_file;
+  uint16_t _recordSize;
+  uint16_t _perBlock;
+  uint32_t _blocks;       ///< 已写满的块数
+  uint16_t _blockCount;   ///< 当前块已写入的记录条数
+  uint32_t _blockFirst;
+  uint32_t _records;
+  uint32_t _firstTs;
+  uint32_t _lastTs;
+  uint32_t _readBlock;
+  uint16_t _readIdx;
+};
+#endif
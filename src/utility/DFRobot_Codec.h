@@ -0,0 +1,181 @@
+/*!
+ * @file DFRobot_Codec.h
+ * @brief 定义 DFRobot_Codec 编码特性模板的基础结构
+ * @details 把数据按固定的小端格式编码成字节流，编码结果与CPU字节序、结构体对齐无关，AVR写入的文件可以在ESP32上读出
+ * @n 整数只支持char和int8_t~uint64_t等定宽类型，按其宽度小端存储；float存为4字节IEEE754；double统一存为8字节IEEE754(AVR上double只有4字节，编码时转换)
+ * @n bool存为1字节；数组T[N]依次编码N个元素；自定义类型特化DFRobot_Codec即可，见DFRobot_Codec模板的说明
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-10-09
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#ifndef __DFROBOT_CODEC_H
+#define __DFROBOT_CODEC_H
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+/**
+ * @brief 编码特性，每种可序列化的类型对应一个特化，需要提供：
+ * @n enum{ size = 编码后的字节数 };
+ * @n static uint8_t *encode(uint8_t *p, const T &v);        把v编码到p，返回p + size
+ * @n static const uint8_t *decode(const uint8_t *p, T &v);  从p解码到v，返回p + size
+ * @n 自定义结构体逐个成员调用DFRobot_Encode/DFRobot_Decode，例如：
+ * @n template<> struct DFRobot_Codec<sSample_t>{
+ * @n   enum{ size = DFRobot_Codec<uint32_t>::size + DFRobot_Codec<int16_t>::size };
+ * @n   static uint8_t *encode(uint8_t *p, const sSample_t &v){ p = DFRobot_Encode(p, v.ts); return DFRobot_Encode(p, v.temp); }
+ * @n   static const uint8_t *decode(const uint8_t *p, sSample_t &v){ p = DFRobot_Decode(p, v.ts); return DFRobot_Decode(p, v.temp); }
+ * @n };
+ */
+template<typename T> struct DFRobot_Codec;
+
+/**
+ * @brief 把模板参数放到不可推导的位置，write<T>必须显式写出T，
+ * @n 这样write(65)之类的调用仍然匹配Print::write(uint8_t)，不会被模板改成写4字节
+ */
+template<typename T> struct DFRobot_CodecArg{ typedef T type; };
+
+template<typename T>
+inline uint8_t *DFRobot_Encode(uint8_t *p, const T &v) { return DFRobot_Codec<T>::encode(p, v); }
+
+template<typename T>
+inline const uint8_t *DFRobot_Decode(const uint8_t *p, T &v) { return DFRobot_Codec<T>::decode(p, v); }
+
+/**
+ * @brief 整数编码，U是与T同样大小的无符号类型，先转换成U再移位，避免对负数右移
+ */
+template<typename T, typename U>
+struct DFRobot_IntCodec{
+  enum{ size = sizeof(T) };
+  static uint8_t *encode(uint8_t *p, const T &v){
+    U u = (U)v;
+    for(uint8_t i = 0; i < sizeof(T); i++){
+      *p++ = (uint8_t)u;
+      u >>= 8;
+    }
+    return p;
+  }
+  static const uint8_t *decode(const uint8_t *p, T &v){
+    U u = 0;
+    for(uint8_t i = sizeof(T); i > 0; i--){
+      u = (U)((u << 8) | p[i - 1]);
+    }
+    v = (T)u;
+    return p + sizeof(T);
+  }
+};
+
+#define DFROBOT_INT_CODEC(T, U) \
+  template<> struct DFRobot_Codec<T> : DFRobot_IntCodec<T, U>{};
+
+/* 只特化定宽整数，编码宽度由类型名决定，与平台无关。int、long等只在恰好是某个定宽类型别名的平台上可用，
+   宽度仍随平台变化(int在AVR上是int16_t、ESP32上是int32_t)，需要跨平台读写的数据请显式使用定宽类型 */
+DFROBOT_INT_CODEC(char,     unsigned char)
+DFROBOT_INT_CODEC(int8_t,   uint8_t)
+DFROBOT_INT_CODEC(uint8_t,  uint8_t)
+DFROBOT_INT_CODEC(int16_t,  uint16_t)
+DFROBOT_INT_CODEC(uint16_t, uint16_t)
+DFROBOT_INT_CODEC(int32_t,  uint32_t)
+DFROBOT_INT_CODEC(uint32_t, uint32_t)
+DFROBOT_INT_CODEC(int64_t,  uint64_t)
+DFROBOT_INT_CODEC(uint64_t, uint64_t)
+
+template<> struct DFRobot_Codec<bool>{
+  enum{ size = 1 };
+  static uint8_t *encode(uint8_t *p, const bool &v) { *p = v ? 1 : 0; return p + 1; }
+  static const uint8_t *decode(const uint8_t *p, bool &v) { v = (*p != 0); return p + 1; }
+};
+
+template<> struct DFRobot_Codec<float>{
+  enum{ size = 4 };
+  static uint8_t *encode(uint8_t *p, const float &v){
+    uint32_t u;
+    memcpy(&u, &v, 4);
+    return DFRobot_Encode(p, u);
+  }
+  static const uint8_t *decode(const uint8_t *p, float &v){
+    uint32_t u;
+    p = DFRobot_Decode(p, u);
+    memcpy(&v, &u, 4);
+    return p;
+  }
+};
+
+template<> struct DFRobot_Codec<double>{
+  enum{ size = 8 };
+#if defined(__AVR__)
+  /* AVR的double就是float，编码时把binary32转换成binary64，非规格化数解码时按0处理 */
+  static uint8_t *encode(uint8_t *p, const double &v){
+    uint32_t f;
+    memcpy(&f, &v, 4);
+    uint32_t sign = f & 0x80000000UL;
+    int16_t exp = (f >> 23) & 0xFF;
+    uint32_t man = f & 0x7FFFFFUL;
+    if(exp == 0xFF){
+      exp = 0x7FF;
+    }else if(exp == 0){
+      if(man){
+        exp = 1;
+        while(!(man & 0x800000UL)){ man <<= 1; exp--; }
+        man &= 0x7FFFFFUL;
+        exp += 1023 - 127;
+      }
+    }else{
+      exp += 1023 - 127;
+    }
+    uint32_t lo = man << 29;
+    uint32_t hi = sign | ((uint32_t)exp << 20) | (man >> 3);
+    p = DFRobot_Encode(p, lo);
+    return DFRobot_Encode(p, hi);
+  }
+  static const uint8_t *decode(const uint8_t *p, double &v){
+    uint32_t lo, hi, f;
+    p = DFRobot_Decode(p, lo);
+    p = DFRobot_Decode(p, hi);
+    int16_t exp = (hi >> 20) & 0x7FF;
+    uint32_t man = ((hi & 0xFFFFFUL) << 3) | (lo >> 29);
+    f = hi & 0x80000000UL;
+    if(exp == 0x7FF){
+      f |= 0x7F800000UL | (man ? 0x400000UL : 0);
+    }else if(exp > 1023 + 127){
+      f |= 0x7F800000UL;
+    }else if(exp > 1023 - 127){
+      f |= ((uint32_t)(exp - 1023 + 127) << 23) | man;
+    }
+    memcpy(&v, &f, 4);
+    return p;
+  }
+#else
+  static uint8_t *encode(uint8_t *p, const double &v){
+    uint64_t u;
+    memcpy(&u, &v, 8);
+    return DFRobot_Encode(p, u);
+  }
+  static const uint8_t *decode(const uint8_t *p, double &v){
+    uint64_t u;
+    p = DFRobot_Decode(p, u);
+    memcpy(&v, &u, 8);
+    return p;
+  }
+#endif
+};
+
+template<typename T, size_t N>
+struct DFRobot_Codec<T[N]>{
+  enum{ size = N * DFRobot_Codec<T>::size };
+  static uint8_t *encode(uint8_t *p, const T (&v)[N]){
+    for(size_t i = 0; i < N; i++) p = DFRobot_Codec<T>::encode(p, v[i]);
+    return p;
+  }
+  static const uint8_t *decode(const uint8_t *p, T (&v)[N]){
+    for(size_t i = 0; i < N; i++) p = DFRobot_Codec<T>::decode(p, v[i]);
+    return p;
+  }
+};
+
+#endif
@@ -0,0 +1,42 @@
+/*!
+ * @file DFRobot_Crc32.h
+ * @brief 定义 DFRobot_Crc32 类的基础结构
+ * @details CRC-32(IEEE 802.3，多项式0xEDB88320，初值和结果取反)，与zlib的crc32()及模块CMD_CRC32命令的结果相同
+ * @n 默认使用slice-by-8查表法，表占8KB flash；AVR上默认使用单表查表法，表放在PROGMEM中只占1KB
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-10-09
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#ifndef __DFROBOT_CRC32_H
+#define __DFROBOT_CRC32_H
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#ifndef CRC32_SLICE_BY_8
+#if defined(__AVR__)
+#define CRC32_SLICE_BY_8  0
+#else
+#define CRC32_SLICE_BY_8  1
+#endif
+#endif
+
+class DFRobot_Crc32{
+public:
+  /**
+   * @fn update
+   * @brief 在已有的CRC上继续计算一段数据，可分多次调用，结果与一次计算全部数据相同
+   * @param crc  前面数据的CRC，第一段数据传0
+   * @param data 数据
+   * @param len  数据长度
+   * @return 加上这段数据后的CRC
+   */
+  static uint32_t update(uint32_t crc, const void *data, size_t len);
+};
+#endif
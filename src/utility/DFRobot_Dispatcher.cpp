@@ -0,0 +1,133 @@
+/*!
+ * @file DFRobot_Dispatcher.cpp
+ * @brief 定义 DFRobot_Dispatcher 类的实现
+ * @details 请求队列是单链表，调度任务每次取走整个队列：执行一条大的请求期间到达的小请求会在下一轮一起取出，
+ * @n 由handler决定是否合并成一条命令发送
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-10-09
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#include "DFRobot_Dispatcher.h"
+
+#if FLASH_THREAD_SAFE
+
+DFRobot_Dispatcher::DFRobot_Dispatcher()
+  :_running(false), _handler(NULL), _arg(NULL), _head(NULL), _tail(NULL){}
+
+void DFRobot_Dispatcher::loop(){
+  while(true){
+    sRequest_t *list;
+#if defined(ARDUINO_ARCH_ESP32)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    list = _head;
+    _head = _tail = NULL;
+    xSemaphoreGive(_lock);
+#else
+    pthread_mutex_lock(&_lock);
+    while(_head == NULL) pthread_cond_wait(&_wake, &_lock);
+    list = _head;
+    _head = _tail = NULL;
+    pthread_mutex_unlock(&_lock);
+#endif
+    while(list){
+      uint8_t n = _handler(_arg, list);
+      if(n == 0) n = 1;
+      //请求在调用者的栈上，完成后调用者返回，必须先取出next
+      while(n-- && list){
+        sRequest_t *next = list->next;
+        complete(list);
+        list = next;
+      }
+    }
+  }
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+void DFRobot_Dispatcher::entry(void *p){
+  ((DFRobot_Dispatcher *)p)->loop();
+}
+
+bool DFRobot_Dispatcher::start(handler_t handler, void *arg, uint32_t stack, uint8_t priority){
+  if(_running) return true;
+  _handler = handler;
+  _arg = arg;
+  _lock = xSemaphoreCreateMutexStatic(&_lockBuf);
+  if(xTaskCreate(entry, "flash", stack, this, priority, &_task) != pdPASS) return false;
+  _running = true;
+  return true;
+}
+
+bool DFRobot_Dispatcher::needed(){
+  return _running && (xTaskGetCurrentTaskHandle() != _task);
+}
+
+void DFRobot_Dispatcher::submit(sRequest_t *req){
+  req->next = NULL;
+  req->done = xSemaphoreCreateBinaryStatic(&req->doneBuf);
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if(_tail) _tail->next = req;
+  else _head = req;
+  _tail = req;
+  xSemaphoreGive(_lock);
+  xTaskNotifyGive(_task);
+  xSemaphoreTake(req->done, portMAX_DELAY);
+  vSemaphoreDelete(req->done);
+}
+
+void DFRobot_Dispatcher::complete(sRequest_t *req){
+  xSemaphoreGive(req->done);
+}
+
+#else
+
+void *DFRobot_Dispatcher::entry(void *p){
+  ((DFRobot_Dispatcher *)p)->loop();
+  return NULL;
+}
+
+bool DFRobot_Dispatcher::start(handler_t handler, void *arg, uint32_t stack, uint8_t priority){
+  (void)stack;
+  (void)priority;
+  if(_running) return true;
+  _handler = handler;
+  _arg = arg;
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_wake, NULL);
+  pthread_cond_init(&_done, NULL);
+  if(pthread_create(&_thread, NULL, entry, this) != 0) return false;
+  pthread_detach(_thread);
+  _running = true;
+  return true;
+}
+
+bool DFRobot_Dispatcher::needed(){
+  return _running && !pthread_equal(pthread_self(), _thread);
+}
+
+void DFRobot_Dispatcher::submit(sRequest_t *req){
+  req->next = NULL;
+  req->done = false;
+  pthread_mutex_lock(&_lock);
+  if(_tail) _tail->next = req;
+  else _head = req;
+  _tail = req;
+  pthread_cond_signal(&_wake);
+  while(!req->done) pthread_cond_wait(&_done, &_lock);
+  pthread_mutex_unlock(&_lock);
+}
+
+void DFRobot_Dispatcher::complete(sRequest_t *req){
+  pthread_mutex_lock(&_lock);
+  req->done = true;
+  pthread_cond_broadcast(&_done);
+  pthread_mutex_unlock(&_lock);
+}
+
+#endif
+
+#endif
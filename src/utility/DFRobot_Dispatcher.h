@@ -0,0 +1,120 @@
+/*!
+ * @file DFRobot_Dispatcher.h
+ * @brief 定义 DFRobot_Dispatcher 类的基础结构
+ * @details 多个任务共用一个模块时，由一个调度任务独占通信接口，其他任务把请求放入队列后等待各自的请求完成，
+ * @n 不会出现两个任务的发送和接收交错、互相读走对方响应的情况。
+ * @n ESP32上使用FreeRTOS任务和信号量；其他定义了FLASH_THREAD_SAFE为1的平台(如Linux主机)使用pthread
+ * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Arya](xue.peng@dfrobot.com)
+ * @version  V1.0
+ * @date  2021-10-09
+ * @url https://github.com/DFRobot/DFRobot_Flash_Moudle
+ */
+#ifndef __DFROBOT_DISPATCHER_H
+#define __DFROBOT_DISPATCHER_H
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+///< 是否编译多任务调度支持，ESP32上默认编译，调用startDispatcher后生效
+#ifndef FLASH_THREAD_SAFE
+#if defined(ARDUINO_ARCH_ESP32)
+#define FLASH_THREAD_SAFE  1
+#else
+#define FLASH_THREAD_SAFE  0
+#endif
+#endif
+
+#if FLASH_THREAD_SAFE
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifndef FLASH_DISPATCHER_STACK
+#define FLASH_DISPATCHER_STACK     4096  ///< 调度任务的栈大小，单位字节
+#endif
+#ifndef FLASH_DISPATCHER_PRIORITY
+#define FLASH_DISPATCHER_PRIORITY  5     ///< 调度任务的优先级，应高于调用文件操作的任务
+#endif
+
+class DFRobot_Dispatcher{
+public:
+  /**
+   * @struct sRequest_t
+   * @brief 请求的公共部分，放在调用者的栈上，完成之前调用者一直阻塞等待
+   */
+  typedef struct sRequest{
+    struct sRequest *next;
+#if defined(ARDUINO_ARCH_ESP32)
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuf;
+#else
+    bool done;
+#endif
+  }sRequest_t;
+
+  /**
+   * @brief 调度任务处理请求的函数，从list开头处理一条或连续几条请求，返回处理的条数
+   */
+  typedef uint8_t (*handler_t)(void *arg, sRequest_t *list);
+
+  DFRobot_Dispatcher();
+
+  /**
+   * @fn start
+   * @brief 创建调度任务
+   * @param handler  在调度任务中处理请求的函数
+   * @param arg      传给handler的参数
+   * @param stack    调度任务的栈大小，pthread上忽略
+   * @param priority 调度任务的优先级，pthread上忽略
+   * @return 创建结果，已经启动时返回true
+   */
+  bool start(handler_t handler, void *arg, uint32_t stack, uint8_t priority);
+
+  /**
+   * @fn needed
+   * @brief 判断当前调用是否需要交给调度任务执行：调度任务已启动，且调用者不是调度任务本身
+   */
+  bool needed();
+
+  /**
+   * @fn submit
+   * @brief 把请求放入队列，阻塞到调度任务处理完这条请求
+   * @param req 请求
+   */
+  void submit(sRequest_t *req);
+
+private:
+  void loop();
+  void complete(sRequest_t *req);
+#if defined(ARDUINO_ARCH_ESP32)
+  static void entry(void *p);
+  TaskHandle_t _task;
+  SemaphoreHandle_t _lock;
+  StaticSemaphore_t _lockBuf;
+#else
+  static void *entry(void *p);
+  pthread_t _thread;
+  pthread_mutex_t _lock;
+  pthread_cond_t _wake;   ///< 有新请求
+  pthread_cond_t _done;   ///< 有请求完成，各调用者检查自己的done
+#endif
+  bool _running;
+  handler_t _handler;
+  void *_arg;
+  sRequest_t *_head;
+  sRequest_t *_tail;
+};
+
+#endif
+
+#endif
@@ -29,6 +29,7 @@
 
 class DFRobot_Driver{
 public:
+  DFRobot_Driver():_readyMode(false), _ready(false){}
   /**
    * @fn sendData
    * @brief  发送数据到I2C总线
@@ -61,6 +62,52 @@ public:
    * @return None
    */
   virtual void flush() = 0;
+  /**
+   * @fn setReadyMode
+   * @brief 设置就绪模式，开启后协议层不再轮询响应状态字节，而是等待notifyReady通知后一次读出响应
+   * @param enable 是否开启就绪模式
+   * @return None
+   */
+  void setReadyMode(bool enable) { _readyMode = enable; _ready = false; }
+  /**
+   * @fn readyMode
+   * @brief 获取是否开启了就绪模式
+   * @return 开启返回true
+   */
+  bool readyMode() { return _readyMode; }
+  /**
+   * @fn notifyReady
+   * @brief 通知协议层模块的响应已准备好，可以在就绪引脚的中断服务函数或用户注册的回调中调用
+   * @return None
+   */
+  void notifyReady() { _ready = true; }
+  /**
+   * @fn clearReady
+   * @brief 清除就绪标志，协议层在发送命令前调用
+   * @return None
+   */
+  void clearReady() { _ready = false; }
+  /**
+   * @fn waitReady
+   * @brief 等待模块的响应准备好
+   * @param timeout 超时时间，单位ms
+   * @return 等待结果
+   * @retval true  响应已准备好
+   * @retval false 超时
+   */
+  virtual bool waitReady(uint32_t timeout){
+    uint32_t t = millis();
+    while(!_ready){
+      if(millis() - t >= timeout) return false;
+      yield();
+    }
+    _ready = false;
+    return true;
+  }
+
+protected:
+  bool _readyMode;
+  volatile bool _ready;
 };
 
 
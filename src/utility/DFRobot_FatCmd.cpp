@@ -21,6 +21,16 @@
  * @n CMD_REWIND           回到读目录起始位置
  * @n CMD_ABSPATH          获取当前目录或文件的绝对路径
  * @n CMD_PARENTDIR        获取当前目录或文件的父级目录路径  
+ * @n CMD_VERSION          读取模块协议版本及扩展命令支持情况
+ * @n CMD_BATCH            批处理命令，一个命令包内携带多条子命令，模块依次执行后返回一个合并的响应包
+ * @n CMD_MKDIRS           递归创建目录，相当于mkdir -p
+ * @n CMD_RMTREE           递归移除目录及其下所有文件和子目录，相当于rm -r
+ * @n CMD_READ_DIR_PLUS    读取目录项，同时返回目录项的属性和大小
+ * @n CMD_RESERVE          为文件预分配连续簇，不改变文件的逻辑大小
+ * @n CMD_PREAD            从文件指定位置读数据，不改变文件读写指针
+ * @n CMD_PWRITE           向文件指定位置写数据，不改变文件读写指针
+ * @n CMD_CRC32            计算文件指定范围的CRC-32
+ * @n CMD_RENAME           重命名或移动文件、目录，只修改目录项，不复制数据
  * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
  * @license     The MIT License (MIT)
  * @author [Arya](xue.peng@dfrobot.com)
@@ -66,7 +76,17 @@
 #define CMD_REWIND          0x11  ///< 回到读目录起始位置
 #define CMD_ABSPATH         0x12  ///< 获取当前目录或文件的绝对路径
 #define CMD_PARENTDIR       0x13  ///< 获取当前目录或文件的父级目录路径  
-#define CMD_END             CMD_PARENTDIR
+#define CMD_VERSION         0x14  ///< 读取协议版本及扩展命令支持情况，旧版本固件以STATUS_FAILED应答
+#define CMD_BATCH           0x15  ///< 批处理命令，数据为子命令个数加上依次排列的子命令包，响应为依次排列的子命令响应包
+#define CMD_MKDIRS          0x16  ///< 递归创建目录命令
+#define CMD_RMTREE          0x17  ///< 递归移除目录命令
+#define CMD_READ_DIR_PLUS   0x18  ///< 读取目录项命令，响应为属性(1) + 大小(4) + 以'\0'结尾的名字，读完时响应长度为0
+#define CMD_RESERVE         0x19  ///< 文件预分配命令，数据为文件id(1) + 预分配后占用的总字节数(4)
+#define CMD_PREAD           0x1A  ///< 定位读命令，数据为文件id(1) + 偏移(4) + 长度(2)，响应为读到的数据
+#define CMD_PWRITE          0x1B  ///< 定位写命令，数据为文件id(1) + 偏移(4) + 要写入的数据，响应为写入的字节数(2)
+#define CMD_CRC32           0x1C  ///< 文件校验命令，数据为文件id(1) + 偏移(4) + 长度(4)，响应为CRC-32(4)
+#define CMD_RENAME          0x1D  ///< 重命名命令，数据为父级目录id(1) + 以'\0'结尾的原路径 + 以'\0'结尾的新路径，新路径是已存在的文件时原子地替换它
+#define CMD_END             CMD_RENAME
 
 #define STATUS_SUCCESS      0x53  ///< 响应成功状态   
 #define STATUS_FAILED       0x63  ///< 响应成功状态  
@@ -74,22 +94,21 @@
 #define IIC_MAX_TRANSFER    32     ///< I2C最大传输数据
 
 #define DEBUG_TIMEOUT_MS    20000
+#define CRC32_TIMEOUT_MS    60000  ///< 模块计算整个大文件的CRC需要较长时间
+#define VERSION_TIMEOUT_MS  1000   ///< 旧版本固件可能不应答CMD_VERSION，不能让begin阻塞DEBUG_TIMEOUT_MS
 
-static DFRobot_Driver *_drv = NULL;
+#define BATCH_PREV_ID       0x7F   ///< 批处理子命令中的文件id为此值时，模块使用本批次中上一条CMD_OPEN_FILE得到的id
 
-typedef struct{
-  uint8_t cmd;           /**< 命令，范围0x00~0x0E,0x0F及之后为无效命令 */
-  union{
-    struct{
-      uint8_t bit0:1;
-      uint8_t bit1:1;
-      uint8_t rsv: 6;
-    };
-    uint8_t fix;           /**< 固定判定，bit0为1表示sendLen为固定数据， bit1为1表示responseLen为固定数据*/
-  };
-  uint16_t sendLen;      /**< 此命令发送包有效数据的长度，如果为0xFFFF则代表不是固定反应  */
-  uint16_t responseLen;  /**< 此命令响应包有效数据的长度，如果为0xFFFF则代表不是固定反应  */
-}__attribute__ ((packed)) sCmdStruct_t, *pCmdStruct_t;
+#if FLASH_THREAD_SAFE
+//调度任务已启动且调用者不是调度任务时，把本次调用交给调度任务执行，等待完成后返回结果
+#define FLASH_DISPATCH(type, call) \
+  if(_dispatcher.needed()){ type _ret; dispatch([&](){ _ret = call; }); return _ret; }
+#else
+#define FLASH_DISPATCH(type, call)
+#endif
+
+#define DIR_MAX_DEPTH       10     ///< 包括根目录在内，目录最多10级
+#define NAME_MAX_LEN        13     ///< 8.3短文件名加'\0'
 
 typedef struct{
   uint8_t cmd;    /**< 命令，范围0x00~0x0E,0x0F及之后为无效命令 */
@@ -105,96 +124,142 @@ typedef struct{
   uint8_t lenH;     /**< 除去具体命令后的数据长度高位，这个一般用来计算buf数组的长度 */
   uint8_t buf[0];   /**< 0长度数组，它的大小取决于上一个变量len的值 */
 }__attribute__ ((packed)) sResponseCmdPkt_t, *pResponseCmdPkt_t;
-//const uint8_t SIMKAIFont12ptBitmaps[] PROGMEM
-static const uint8_t  DFR0870_CMD_STRUCT[] PROGMEM = {
-  CMD_RESET,      0x03, 0, 0 ,
-  CMD_FLASH_INFO, 0x03, 0, 11,
-  CMD_READ_ADDR,  0x03, 0, 1 ,
-  CMD_SET_ADDR,   0x03, 1, 0 ,
-  CMD_OPEN_FILE,  0x02, 2, 9 ,
-  CMD_CLOSE_FILE, 0x03, 2, 0 ,
-  CMD_WRITE_FILE, 0x02, 1, 2 ,
-  CMD_READ_FILE,  0x01, 3, 0 ,
-  CMD_SYNC_FILE,  0x03, 1, 0 ,
-  CMD_SEEK_FILE,  0x03, 5, 4 ,
-  CMD_MKDIR,      0x00, 1, 0 ,
-  CMD_OPEN_DIR,   0x00, 1, 1 ,
-  CMD_CLOSE_DIR,  0x01, 1, 0 ,
-  CMD_REMOVE,     0x02, 1, 0 ,
-  CMD_FILE_ATTR,  0x02, 1, 1 ,
-  CMD_READ_DIR,   0x01, 1, 0 ,
-  CMD_REWIND,     0x03, 1, 0 ,
-  CMD_ABSPATH,    0x01, 2, 0 ,
-  CMD_PARENTDIR,  0x01, 2, 0 ,
-};
+/**
+ * @brief 命令描述符，编译期常量，取代原来放在PROGMEM中、运行时用pgm_read_byte查询的命令表
+ * @n sCmdDesc<CMD>::sendLen 和 sCmdDesc<CMD>::responseLen 在编译时就是常量，响应长度的检查由编译器折叠成立即数比较
+ */
+template<uint8_t CMD> struct sCmdDesc;
 
-static sCmdStruct_t getCmdStructConfig(uint8_t cmd){
-  sCmdStruct_t cmdStu;
-  if(cmd < CMD_START || cmd > CMD_END){
-    memset(&cmdStu, 0, sizeof(sCmdStruct_t));
-    return cmdStu;
+#define DFR0870_CMD_DESC(c, f, s, r) \
+  template<> struct sCmdDesc<c>{ \
+    enum{ cmd = c, fix = f, sendLen = s, responseLen = r }; \
+  };
+
+DFR0870_CMD_DESC(CMD_RESET,         0x03, 0, 0 )
+DFR0870_CMD_DESC(CMD_FLASH_INFO,    0x03, 0, 11)
+DFR0870_CMD_DESC(CMD_READ_ADDR,     0x03, 0, 1 )
+DFR0870_CMD_DESC(CMD_SET_ADDR,      0x03, 1, 0 )
+DFR0870_CMD_DESC(CMD_OPEN_FILE,     0x02, 2, 9 )
+DFR0870_CMD_DESC(CMD_CLOSE_FILE,    0x03, 2, 0 )
+DFR0870_CMD_DESC(CMD_WRITE_FILE,    0x02, 1, 2 )
+DFR0870_CMD_DESC(CMD_READ_FILE,     0x01, 3, 0 )
+DFR0870_CMD_DESC(CMD_SYNC_FILE,     0x03, 1, 0 )
+DFR0870_CMD_DESC(CMD_SEEK_FILE,     0x03, 5, 4 )
+DFR0870_CMD_DESC(CMD_MKDIR,         0x00, 1, 0 )
+DFR0870_CMD_DESC(CMD_OPEN_DIR,      0x00, 1, 1 )
+DFR0870_CMD_DESC(CMD_CLOSE_DIR,     0x01, 1, 0 )
+DFR0870_CMD_DESC(CMD_REMOVE,        0x02, 1, 0 )
+DFR0870_CMD_DESC(CMD_FILE_ATTR,     0x02, 1, 1 )
+DFR0870_CMD_DESC(CMD_READ_DIR,      0x01, 1, 0 )
+DFR0870_CMD_DESC(CMD_REWIND,        0x03, 1, 0 )
+DFR0870_CMD_DESC(CMD_ABSPATH,       0x01, 2, 0 )
+DFR0870_CMD_DESC(CMD_PARENTDIR,     0x01, 2, 0 )
+DFR0870_CMD_DESC(CMD_VERSION,       0x03, 0, 5 )
+DFR0870_CMD_DESC(CMD_BATCH,         0x00, 1, 0 )
+DFR0870_CMD_DESC(CMD_MKDIRS,        0x02, 1, 0 )
+DFR0870_CMD_DESC(CMD_RMTREE,        0x02, 1, 0 )
+DFR0870_CMD_DESC(CMD_READ_DIR_PLUS, 0x01, 1, 0 )
+DFR0870_CMD_DESC(CMD_RESERVE,       0x03, 5, 0 )
+DFR0870_CMD_DESC(CMD_PREAD,         0x01, 7, 0 )
+DFR0870_CMD_DESC(CMD_PWRITE,        0x02, 5, 2 )
+DFR0870_CMD_DESC(CMD_CRC32,         0x03, 9, 4 )
+DFR0870_CMD_DESC(CMD_RENAME,        0x02, 1, 0 )
+
+/**
+ * @brief 定长命令的发送包，放在栈上，不需要malloc和free
+ */
+template<uint8_t CMD>
+struct sCmdPkt{
+  uint8_t raw[SEND_PKT_PRE_FIX_LEN + sCmdDesc<CMD>::sendLen];
+  pSendCmdPkt_t packed(){
+    raw[0] = CMD;
+    raw[1] = sCmdDesc<CMD>::sendLen & 0xFF;
+    raw[2] = (sCmdDesc<CMD>::sendLen >> 8) & 0xFF;
+    return (pSendCmdPkt_t)raw;
   }
-  uint8_t *addr = (uint8_t *)(DFR0870_CMD_STRUCT + 4 * (cmd - 1));
-  cmdStu.cmd         = pgm_read_byte(addr++);
-  cmdStu.fix         = pgm_read_byte(addr++);
-  cmdStu.sendLen     = (uint16_t)pgm_read_byte(addr++);
-  cmdStu.responseLen = (uint16_t)pgm_read_byte(addr);
+};
+
+#if FLASH_THREAD_SAFE
+template<typename F>
+void DFRobot_DFR0870_Protocol::callRequest(void *fn){
+  (*(F *)fn)();
+}
 
-  return cmdStu;
+template<typename F>
+void DFRobot_DFR0870_Protocol::dispatch(F fn){
+  sRequest_t req;
+  req.call = callRequest<F>;
+  req.fn = &fn;
+  _dispatcher.submit(&req.head);
 }
 
-void * DFRobot_DFR0870_Protocol::recvCmdResponsePkt(uint8_t cmd){
+#endif
+
+void * DFRobot_DFR0870_Protocol::recvCmdResponsePkt(uint8_t cmd, uint32_t timeout){
   if(cmd < CMD_START || cmd > CMD_END){
     CMD_DBG("cmd is error!");
     return NULL;
   }
+  if(timeout == 0) timeout = DEBUG_TIMEOUT_MS;
   sResponseCmdPkt_t responsePkt;
   pResponseCmdPkt_t responsePktPtr = NULL;
   uint16_t length = 0;
+  if(!recvResponseHead(cmd, &responsePkt, timeout)){
+    CMD_DBG("Time out!");
+    return NULL;
+  }
+  length = (responsePkt.lenH << 8) | responsePkt.lenL;
+  CMD_DBG(responsePkt.lenH,HEX);
+  CMD_DBG(responsePkt.lenL,HEX);
+  CMD_DBG(length,HEX);
+  responsePktPtr = (pResponseCmdPkt_t)malloc(sizeof(sResponseCmdPkt_t) + length);
+  if(responsePktPtr == NULL){
+    CMD_DBG("responsePktPtr malloc failed!");
+    CMD_DBG(cmd, HEX);
+    CMD_DBG(length);
+    return NULL;
+  }
+  memcpy(responsePktPtr, &responsePkt, sizeof(sResponseCmdPkt_t));
+  if(length) readResponseData(responsePktPtr->buf, length);
+  return responsePktPtr;
+}
+
+bool DFRobot_DFR0870_Protocol::recvResponseHead(uint8_t cmd, void *head, uint32_t timeout){
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)head;
+  if(_drv && _drv->readyMode()){
+    //就绪模式：等模块通知响应已准备好，再一次读出整个包头，不轮询状态字节
+    if(!_drv->waitReady(timeout)) return false;
+    if(!readResponseData(&responsePkt->state, sizeof(sResponseCmdPkt_t))) return false;
+    if((responsePkt->state != STATUS_SUCCESS) && (responsePkt->state != STATUS_FAILED)) return false;
+    return responsePkt->cmd == cmd;
+  }
   uint32_t t = millis();
-  while(millis() - t < DEBUG_TIMEOUT_MS/*time_ms*/){
-    readResponseData(&responsePkt.state, 1);
+  while(millis() - t < timeout){
+    readResponseData(&responsePkt->state, 1);
 RECVYIMEOUTFLAG:
     delay(50);
     yield();
-    if((responsePkt.state == STATUS_SUCCESS) || (responsePkt.state == STATUS_FAILED)) {
-      readResponseData(&responsePkt.cmd, 1);
-      if(responsePkt.cmd == cmd){
-        readResponseData(&responsePkt.lenL, 2);
-        length = (responsePkt.lenH << 8) | responsePkt.lenL;
-        CMD_DBG(responsePkt.lenH,HEX);
-        CMD_DBG(responsePkt.lenL,HEX);
-        CMD_DBG(length,HEX);
-        responsePktPtr = (pResponseCmdPkt_t)malloc(sizeof(sResponseCmdPkt_t) + length);
-        if(responsePktPtr == NULL){
-          CMD_DBG("responsePktPtr malloc failed!");
-          CMD_DBG(cmd, HEX);
-          CMD_DBG(length);
-          return NULL;
-        }
-        memcpy(responsePktPtr, &responsePkt, sizeof(sResponseCmdPkt_t));
-        if(length) readResponseData(responsePktPtr->buf, length);
-        CMD_DBG(millis() - t);
-        return responsePktPtr;
+    if((responsePkt->state == STATUS_SUCCESS) || (responsePkt->state == STATUS_FAILED)) {
+      readResponseData(&responsePkt->cmd, 1);
+      if(responsePkt->cmd == cmd){
+        readResponseData(&responsePkt->lenL, 2);
+        return true;
       }else{
-        responsePkt.state = responsePkt.cmd;
+        responsePkt->state = responsePkt->cmd;
         goto RECVYIMEOUTFLAG;
       }
     }
-    
   }
-  CMD_DBG("Time out!");
-  return NULL;
+  return false;
 }
+
 void * DFRobot_DFR0870_Protocol::packedCmdPacket(uint8_t cmd, uint16_t len){
   if(cmd < CMD_START || cmd > CMD_END){
     CMD_DBG("cmd is error!");
     return NULL;
   }
-  sCmdStruct_t cmdStu = getCmdStructConfig(cmd);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)malloc(sizeof(sSendCmdPkt_t) + cmdStu.sendLen + len);
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)malloc(sizeof(sSendCmdPkt_t) + len);
   if(sendPkt){
-    len += cmdStu.sendLen;
     sendPkt->cmd = cmd;
     sendPkt->lenL = len & 0xFF;
     sendPkt->lenH = (len >> 8) & 0xFF;
@@ -206,6 +271,7 @@ bool DFRobot_DFR0870_Protocol::writeCmdPacket(void *pData, uint16_t size, bool e
   CMD_DBG((uint32_t)((uint32_t *)_drv), HEX);
   if(_drv) {
     CMD_DBG();
+    _drv->clearReady();
     bool ret = _drv->sendData(pData, size, endflag);
     CMD_DBG((uint32_t)((uint32_t *)_drv), HEX);
     return ret;
@@ -227,26 +293,20 @@ bool DFRobot_DFR0870_Protocol::begin(DFRobot_Driver *drv){
 }
 
 bool DFRobot_DFR0870_Protocol::reset(){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_RESET);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("reset: packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, reset());
+  sCmdPkt<CMD_RESET> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL)) == false){
     CMD_DBG("reset: send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_RESET);
   if(responsePkt == NULL){
     CMD_DBG("reset: response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_RESET) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_RESET) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_RESET>::responseLen)){
     CMD_DBG("reset: response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -259,26 +319,20 @@ bool DFRobot_DFR0870_Protocol::reset(){
 }
 
 bool DFRobot_DFR0870_Protocol::getFlashInfo(uint8_t *fatType, uint32_t *capacity, uint32_t *freeSec, uint16_t *maxFileNums){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_FLASH_INFO);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, getFlashInfo(fatType, capacity, freeSec, maxFileNums));
+  sCmdPkt<CMD_FLASH_INFO> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL)) == false){
     CMD_DBG("FlashInfo: send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_FLASH_INFO);
   if(responsePkt == NULL){
     CMD_DBG("FlashInfo: response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_FLASH_INFO) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_FLASH_INFO) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_FLASH_INFO>::responseLen)){
     CMD_DBG("FlashInfo: response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -298,26 +352,21 @@ bool DFRobot_DFR0870_Protocol::getFlashInfo(uint8_t *fatType, uint32_t *capacity
 }
 
 uint8_t DFRobot_DFR0870_Protocol::getI2CAddress(){
+  FLASH_DISPATCH(uint8_t, getI2CAddress());
   uint8_t addr = 0;
-   sCmdStruct_t cmdStu = getCmdStructConfig(CMD_READ_ADDR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  sCmdPkt<CMD_READ_ADDR> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL)) == false){
     CMD_DBG("FlashInfo: send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_READ_ADDR);
   if(responsePkt == NULL){
     CMD_DBG("FlashInfo: response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_READ_ADDR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_READ_ADDR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_READ_ADDR>::responseLen)){
     CMD_DBG("FlashInfo: response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -330,31 +379,25 @@ uint8_t DFRobot_DFR0870_Protocol::getI2CAddress(){
 }
 
 bool DFRobot_DFR0870_Protocol::setI2CAddress(uint8_t addr){
+  FLASH_DISPATCH(bool, setI2CAddress(addr));
   if(addr < 1 || addr > 0x7F){
     CMD_DBG("addr range is error.");
     return false;
   }
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_SET_ADDR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-
-  if(sendPkt == NULL){
-    CMD_DBG("packed malloc failed.");
-    return false;
-  }
+  sCmdPkt<CMD_SET_ADDR> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = addr;
   if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL)) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_SET_ADDR);
   if(responsePkt == NULL){
     CMD_DBG("response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SET_ADDR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SET_ADDR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_SET_ADDR>::responseLen)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -365,8 +408,8 @@ bool DFRobot_DFR0870_Protocol::setI2CAddress(uint8_t addr){
 }
 
 bool DFRobot_DFR0870_Protocol::openFile(const char *name, int8_t pid, uint8_t oflag, int8_t *id, uint32_t *curPos, uint32_t *size){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_OPEN_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, strlen(name) + 1);
+  FLASH_DISPATCH(bool, openFile(name, pid, oflag, id, curPos, size));
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_OPEN_FILE>::cmd, sCmdDesc<CMD_OPEN_FILE>::sendLen + strlen(name) + 1);
 
   if(sendPkt == NULL){
     CMD_DBG("CMD_OPEN_FILE packed malloc failed.");
@@ -388,7 +431,7 @@ bool DFRobot_DFR0870_Protocol::openFile(const char *name, int8_t pid, uint8_t of
     CMD_DBG("CMD_OPEN_FILE response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_OPEN_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_OPEN_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_OPEN_FILE>::responseLen)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -399,67 +442,126 @@ bool DFRobot_DFR0870_Protocol::openFile(const char *name, int8_t pid, uint8_t of
   if(id)     CMD_DBG(*id, HEX);
   if(curPos) CMD_DBG(*curPos, HEX);    
   if(size)   CMD_DBG(*size, HEX);       
+  free(responsePkt);
   return true;
 }
 
 bool DFRobot_DFR0870_Protocol::closeFile(int8_t id, bool truncate){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_CLOSE_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-
-  if(sendPkt == NULL){
-    CMD_DBG("CMD_CLOSE_FILE packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, closeFile(id, truncate));
+  sCmdPkt<CMD_CLOSE_FILE> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   sendPkt->buf[1] = (uint8_t)truncate;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("CMD_CLOSE_FILE send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_CLOSE_FILE);
   if(responsePkt == NULL){
     CMD_DBG("CMD_CLOSE_FILE response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_CLOSE_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_CLOSE_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_CLOSE_FILE>::responseLen)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
   }    
+  free(responsePkt);
   return true;
 }
 
 uint16_t DFRobot_DFR0870_Protocol::writeFile(int8_t id, void *data, uint16_t len){
-  if(_drv == NULL) return 0;
-  uint8_t *pBuf = (uint8_t *)data;
-  uint16_t remain = len;
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_WRITE_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
+  sIoVec_t iov = {data, len};
+  return writeFileV(id, &iov, 1);
+}
 
-  if(sendPkt == NULL){
-    CMD_DBG("CMD_WRITE_FILE packed malloc failed.");
+uint16_t DFRobot_DFR0870_Protocol::writeFileV(int8_t id, const sIoVec_t *iov, uint8_t iovcnt){
+#if FLASH_THREAD_SAFE
+  if(_dispatcher.needed()){
+    uint32_t len = 0;
+    for(uint8_t i = 0; i < iovcnt; i++) len += iov[i].len;
+    if(len <= FLASH_COALESCE_SIZE){
+      //小的写请求不带函数，调度任务可以把连续的几条合并成一条CMD_BATCH
+      sRequest_t req;
+      req.call = NULL;
+      req.id = id;
+      req.iov = iov;
+      req.iovcnt = iovcnt;
+      req.len = len;
+      req.ret = 0;
+      _dispatcher.submit(&req.head);
+      return req.ret;
+    }
+  }
+#endif
+  FLASH_DISPATCH(uint16_t, writeFileV(id, iov, iovcnt));
+  uint8_t param[1] = {(uint8_t)id};
+  if(!writeCmdPacketV(CMD_WRITE_FILE, param, sizeof(param), iov, iovcnt)) return 0;
+  return recvWriteResponse(CMD_WRITE_FILE);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::readFile(int8_t id, void *data, uint16_t len){
+  sIoVec_t iov = {data, len};
+  return readFileV(id, &iov, 1);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::readFileV(int8_t id, const sIoVec_t *iov, uint8_t iovcnt){
+  FLASH_DISPATCH(uint16_t, readFileV(id, iov, iovcnt));
+  uint32_t len = 0;
+  for(uint8_t i = 0; i < iovcnt; i++) len += iov[i].len;
+  if(len > 0xFFFF){
+    CMD_DBG("CMD_READ_FILE too many bytes.");
     return 0;
   }
-  sendPkt->lenL = (len + 1) & 0xFF;
-  sendPkt->lenH = ((len + 1) >> 8) & 0xFF;
+  sCmdPkt<CMD_READ_FILE> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
-  
-  bool flag = _drv->sendData(sendPkt, SEND_PKT_PRE_FIX_LEN + 1, false);
+  sendPkt->buf[1] = len & 0xFF;
+  sendPkt->buf[2] = (len >> 8) & 0xFF;
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_READ_ADDR send packet fail.");
+    return 0;
+  }
+  return recvDataResponse(CMD_READ_FILE, iov, iovcnt);
+}
 
-  if(!flag) return 0;
-  free(sendPkt);
-  flag = _drv->sendData(data, len, true);
-  if(!flag) return 0;
-  
-  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_WRITE_FILE);
+bool DFRobot_DFR0870_Protocol::writeCmdPacketV(uint8_t cmd, const uint8_t *param, uint8_t paramLen, const sIoVec_t *iov, uint8_t iovcnt){
+  if(_drv == NULL) return false;
+  uint32_t len = paramLen;
+  uint8_t last = 0;
+  for(uint8_t i = 0; i < iovcnt; i++){
+    len += iov[i].len;
+    if(iov[i].len) last = i;
+  }
+  if((len > 0xFFFF) || (paramLen > 8)){
+    CMD_DBG("too many bytes.");
+    return false;
+  }
+  uint8_t head[SEND_PKT_PRE_FIX_LEN + 8];
+  head[0] = cmd;
+  head[1] = len & 0xFF;
+  head[2] = (len >> 8) & 0xFF;
+  memcpy(&head[SEND_PKT_PRE_FIX_LEN], param, paramLen);
+  _drv->clearReady();
+  bool flag = _drv->sendData(head, SEND_PKT_PRE_FIX_LEN + paramLen, len == paramLen);
+  if(!flag) return false;
+  // 各段用户缓存依次发送，最后一段才发停止位，模块看到的是一个完整的命令包
+  for(uint8_t i = 0; (i < iovcnt) && (len > paramLen); i++){
+    if(iov[i].len == 0) continue;
+    flag = _drv->sendData(iov[i].buf, iov[i].len, i == last);
+    if(!flag) return false;
+  }
+  return true;
+}
+
+uint16_t DFRobot_DFR0870_Protocol::recvWriteResponse(uint8_t cmd){
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(cmd);
   if(responsePkt == NULL){
-    CMD_DBG("CMD_WRITE_FILE response packet fail.");
+    CMD_DBG("write response packet fail.");
     return 0;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_WRITE_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != cmd) || (((responsePkt->lenH << 8) | responsePkt->lenL) != 2)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return 0;
@@ -470,77 +572,52 @@ uint16_t DFRobot_DFR0870_Protocol::writeFile(int8_t id, void *data, uint16_t len
   return total;
 }
 
-uint16_t DFRobot_DFR0870_Protocol::readFile(int8_t id, void *data, uint16_t len){
+uint16_t DFRobot_DFR0870_Protocol::recvDataResponse(uint8_t cmd, const sIoVec_t *iov, uint8_t iovcnt){
   uint16_t total = 0;
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_READ_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-
-  if(sendPkt == NULL){
-    CMD_DBG("CMD_READ_ADDR packed malloc failed.");
-    return 0;
-  }
-  sendPkt->buf[0] = (uint8_t)id;
-  sendPkt->buf[1] = len & 0xFF;
-  sendPkt->buf[2] = (len >> 8) & 0xFF;
-  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
-    CMD_DBG("CMD_READ_ADDR send packet fail.");
-    free(sendPkt);
-    return 0;
-  }
-  free(sendPkt);
+  uint32_t len = 0;
+  for(uint8_t i = 0; i < iovcnt; i++) len += iov[i].len;
   sResponseCmdPkt_t responsePkt;
   uint16_t length = 0;
   uint16_t recvsize = 0;
-  uint32_t t = millis();
-  while(millis() - t < DEBUG_TIMEOUT_MS/*time_ms*/){
-    delay(50);
-    yield();
-    readResponseData(&responsePkt.state, 1);
-MILLISLOOP:
-    if((responsePkt.state == STATUS_SUCCESS) || (responsePkt.state == STATUS_FAILED)){
-      readResponseData(&responsePkt.cmd, 1);
-      if(responsePkt.cmd == CMD_READ_FILE){
-        readResponseData(&responsePkt.lenL, 2);
-        length = (responsePkt.lenH << 8) | responsePkt.lenL;
-        if(responsePkt.state == STATUS_SUCCESS){
-          total = (len > length) ? length : len;
-          if(total) readResponseData(data, total);
-          return total;
-        }else{
-          return 0;
-        }
-      }else{
-        responsePkt.state = responsePkt.cmd;
-        goto MILLISLOOP;
-      }
-    }
+  if(!recvResponseHead(cmd, &responsePkt, DEBUG_TIMEOUT_MS)) return 0;
+  length = (responsePkt.lenH << 8) | responsePkt.lenL;
+  if(responsePkt.state != STATUS_SUCCESS) return 0;
+  total = (len > length) ? length : len;
+  // 响应数据直接读入各段用户缓存
+  for(uint8_t i = 0; (i < iovcnt) && (recvsize < total); i++){
+    uint16_t n = total - recvsize;
+    if(n > iov[i].len) n = iov[i].len;
+    if(n) readResponseData(iov[i].buf, n);
+    recvsize += n;
+  }
+  // 缓存放不下的数据读出丢弃，不能留给下一条命令的响应
+  while(recvsize < length){
+    uint8_t drop[16];
+    uint16_t n = length - recvsize;
+    if(n > sizeof(drop)) n = sizeof(drop);
+    readResponseData(drop, n);
+    recvsize += n;
   }
-  return 0;
+  return total;
 }
 
 bool DFRobot_DFR0870_Protocol::sync(int8_t id){
+  FLASH_DISPATCH(bool, sync(id));
 
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_SYNC_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  sCmdPkt<CMD_SYNC_FILE> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_SYNC_FILE);
   if(responsePkt == NULL){
     CMD_DBG("response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SYNC_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SYNC_FILE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_SYNC_FILE>::responseLen)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -550,13 +627,9 @@ bool DFRobot_DFR0870_Protocol::sync(int8_t id){
 }
 
 bool DFRobot_DFR0870_Protocol::seekFile(int8_t id, uint32_t pos){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_SEEK_FILE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("CMD_SEEK_FILE packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, seekFile(id, pos));
+  sCmdPkt<CMD_SEEK_FILE> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   sendPkt->buf[1] = pos & 0xFF;
   sendPkt->buf[2] = (pos >> 8) & 0xFF;
@@ -564,17 +637,15 @@ bool DFRobot_DFR0870_Protocol::seekFile(int8_t id, uint32_t pos){
   sendPkt->buf[4] = (pos >> 24) & 0xFF;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("CMD_SEEK_FILE send packet fail.");
-    free(sendPkt);
     return 0;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_SEEK_FILE);
   if(responsePkt == NULL){
     CMD_DBG("CMD_SEEK_FILE response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SEEK_FILE) || (cmdStu.responseLen != ((responsePkt->lenH << 8) | responsePkt->lenL))){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_SEEK_FILE) || (sCmdDesc<CMD_SEEK_FILE>::responseLen != ((responsePkt->lenH << 8) | responsePkt->lenL))){
     CMD_DBG("CMD_SEEK_FILE response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -582,14 +653,15 @@ bool DFRobot_DFR0870_Protocol::seekFile(int8_t id, uint32_t pos){
   uint32_t curpos = ((uint32_t)responsePkt->buf[3] << 24) | ((uint32_t)responsePkt->buf[2] << 16) | ((uint32_t)responsePkt->buf[1] << 8) | (uint32_t)responsePkt->buf[0];
   CMD_DBG(curpos);
   CMD_DBG(pos);
+  free(responsePkt);
   return true;
 }
 
 
 
 bool DFRobot_DFR0870_Protocol::newDirectory(const char *name, int8_t pid){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_MKDIR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, strlen(name) + 1);
+  FLASH_DISPATCH(bool, newDirectory(name, pid));
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_MKDIR>::cmd, sCmdDesc<CMD_MKDIR>::sendLen + strlen(name) + 1);
   
   if(sendPkt == NULL){
     CMD_DBG("FlashInfo: packed malloc failed.");
@@ -611,7 +683,7 @@ bool DFRobot_DFR0870_Protocol::newDirectory(const char *name, int8_t pid){
     CMD_DBG("response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_MKDIR) || (cmdStu.responseLen != ((responsePkt->lenH << 8) | responsePkt->lenL))){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_MKDIR) || (sCmdDesc<CMD_MKDIR>::responseLen != ((responsePkt->lenH << 8) | responsePkt->lenL))){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -621,8 +693,8 @@ bool DFRobot_DFR0870_Protocol::newDirectory(const char *name, int8_t pid){
 }
 
 bool DFRobot_DFR0870_Protocol::openDirectory(const char *name, int8_t pid, int8_t *id){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_OPEN_DIR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, strlen(name) + 1);
+  FLASH_DISPATCH(bool, openDirectory(name, pid, id));
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_OPEN_DIR>::cmd, sCmdDesc<CMD_OPEN_DIR>::sendLen + strlen(name) + 1);
   
   if(sendPkt == NULL){
     CMD_DBG("FlashInfo: packed malloc failed.");
@@ -662,20 +734,14 @@ bool DFRobot_DFR0870_Protocol::openDirectory(const char *name, int8_t pid, int8_
 }
 
 bool DFRobot_DFR0870_Protocol::closeDirectory(int8_t id){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_CLOSE_DIR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, closeDirectory(id));
+  sCmdPkt<CMD_CLOSE_DIR> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_CLOSE_DIR);
   if(responsePkt == NULL){
@@ -691,10 +757,10 @@ bool DFRobot_DFR0870_Protocol::closeDirectory(int8_t id){
   return true;
 }
 
- bool DFRobot_DFR0870_Protocol::remove(int8_t pid, char *name){
+bool DFRobot_DFR0870_Protocol::remove(int8_t pid, char *name){
+  FLASH_DISPATCH(bool, remove(pid, name));
   uint8_t attr = 0;
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_REMOVE);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, strlen(name) + 1);
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_REMOVE>::cmd, sCmdDesc<CMD_REMOVE>::sendLen + strlen(name) + 1);
   
   if(sendPkt == NULL){
     CMD_DBG("FlashInfo: packed malloc failed.");
@@ -716,7 +782,7 @@ bool DFRobot_DFR0870_Protocol::closeDirectory(int8_t id){
     CMD_DBG("response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_REMOVE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen) ){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_REMOVE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_REMOVE>::responseLen) ){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -726,9 +792,9 @@ bool DFRobot_DFR0870_Protocol::closeDirectory(int8_t id){
 }
 
 uint8_t DFRobot_DFR0870_Protocol::getFileAttribute(int8_t pid, char *name){
+  FLASH_DISPATCH(uint8_t, getFileAttribute(pid, name));
   uint8_t attr = 0;
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_FILE_ATTR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, strlen(name) + 1);
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_FILE_ATTR>::cmd, sCmdDesc<CMD_FILE_ATTR>::sendLen + strlen(name) + 1);
   
   if(sendPkt == NULL){
     CMD_DBG("FlashInfo: packed malloc failed.");
@@ -750,7 +816,7 @@ uint8_t DFRobot_DFR0870_Protocol::getFileAttribute(int8_t pid, char *name){
     CMD_DBG("response packet fail.");
     return 0;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_FILE_ATTR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen))
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_FILE_ATTR) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_FILE_ATTR>::responseLen))
   {
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
@@ -763,20 +829,14 @@ uint8_t DFRobot_DFR0870_Protocol::getFileAttribute(int8_t pid, char *name){
 }
 
 bool DFRobot_DFR0870_Protocol::readDirectory(int8_t id,  char *name, uint16_t namebufsize){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_READ_DIR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, readDirectory(id, name, namebufsize));
+  sCmdPkt<CMD_READ_DIR> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_READ_DIR);
   if(responsePkt == NULL){
@@ -794,7 +854,10 @@ bool DFRobot_DFR0870_Protocol::readDirectory(int8_t id,  char *name, uint16_t na
   }
 
   namebufsize = (responsePkt->lenH << 8) | responsePkt->lenL;
-  if(namebufsize == 0) return false;
+  if(namebufsize == 0){
+    free(responsePkt);
+    return false;
+  }
   memcpy(name, responsePkt->buf, namebufsize);
   CMD_DBG(name);
   free(responsePkt);
@@ -802,27 +865,21 @@ bool DFRobot_DFR0870_Protocol::readDirectory(int8_t id,  char *name, uint16_t na
 }
 
 bool DFRobot_DFR0870_Protocol::rewind(int8_t id){
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_REWIND);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return false;
-  }
+  FLASH_DISPATCH(bool, rewind(id));
+  sCmdPkt<CMD_REWIND> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return false;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_REWIND);
   if(responsePkt == NULL){
     CMD_DBG("response packet fail.");
     return false;
   }
-  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_REWIND) || (((responsePkt->lenH << 8) | responsePkt->lenL) != cmdStu.responseLen)){
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_REWIND) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_REWIND>::responseLen)){
     CMD_DBG("response recv packet failrd.");
     free(responsePkt);
     return false;
@@ -832,22 +889,16 @@ bool DFRobot_DFR0870_Protocol::rewind(int8_t id){
 }
 
 String DFRobot_DFR0870_Protocol::getAbsolutePath(int8_t id, uint8_t type){
+  FLASH_DISPATCH(String, getAbsolutePath(id, type));
   String str = "";
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_ABSPATH);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-  
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return str;
-  }
+  sCmdPkt<CMD_ABSPATH> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   sendPkt->buf[1] = type;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return str;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_ABSPATH);
   if(responsePkt == NULL){
@@ -868,22 +919,16 @@ String DFRobot_DFR0870_Protocol::getAbsolutePath(int8_t id, uint8_t type){
   return String(pname);
 }
 String DFRobot_DFR0870_Protocol::getParentDirectory(int8_t id, uint8_t type){
+  FLASH_DISPATCH(String, getParentDirectory(id, type));
   String str = "";
-  sCmdStruct_t cmdStu = getCmdStructConfig(CMD_PARENTDIR);
-  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(cmdStu.cmd, 0);
-
-  if(sendPkt == NULL){
-    CMD_DBG("FlashInfo: packed malloc failed.");
-    return str;
-  }
+  sCmdPkt<CMD_PARENTDIR> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
   sendPkt->buf[0] = (uint8_t)id;
   sendPkt->buf[1] = type;
   if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
     CMD_DBG("send packet fail.");
-    free(sendPkt);
     return str;
   }
-  free(sendPkt);
 
   pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_PARENTDIR);
   if(responsePkt == NULL){
@@ -904,3 +949,668 @@ String DFRobot_DFR0870_Protocol::getParentDirectory(int8_t id, uint8_t type){
   return String(pname);
 }
 
+uint16_t DFRobot_DFR0870_Protocol::getAbsolutePath(int8_t id, uint8_t type, char *buf, uint16_t size){
+  return queryPath(CMD_ABSPATH, id, type, buf, size);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::getParentDirectory(int8_t id, uint8_t type, char *buf, uint16_t size){
+  return queryPath(CMD_PARENTDIR, id, type, buf, size);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::queryPath(uint8_t cmd, int8_t id, uint8_t type, char *buf, uint16_t size){
+  FLASH_DISPATCH(uint16_t, queryPath(cmd, id, type, buf, size));
+  if((buf == NULL) || (size == 0)) return 0;
+  buf[0] = '\0';
+  uint8_t param[2] = {(uint8_t)id, type};
+  if(!writeCmdPacketV(cmd, param, sizeof(param), NULL, 0)){
+    CMD_DBG("send packet fail.");
+    return 0;
+  }
+  sIoVec_t iov = {buf, (uint16_t)(size - 1)};
+  uint16_t n = recvDataResponse(cmd, &iov, 1);
+  buf[n] = '\0';
+  return n;
+}
+
+bool DFRobot_DFR0870_Protocol::queryVersion(){
+  FLASH_DISPATCH(bool, queryVersion());
+  _version = 0;
+  _features = 0;
+  sCmdPkt<CMD_VERSION> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
+  if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL)) == false){
+    CMD_DBG("CMD_VERSION send packet fail.");
+    return false;
+  }
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_VERSION, VERSION_TIMEOUT_MS);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_VERSION response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_VERSION) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_VERSION>::responseLen)){
+    CMD_DBG("CMD_VERSION not supported, legacy firmware.");
+    free(responsePkt);
+    return false;
+  }
+  _version  = responsePkt->buf[0];
+  _features = (uint32_t)responsePkt->buf[1] | ((uint32_t)responsePkt->buf[2] << 8) | ((uint32_t)responsePkt->buf[3] << 16) | ((uint32_t)responsePkt->buf[4] << 24);
+  CMD_DBG(_version);
+  CMD_DBG(_features, HEX);
+  free(responsePkt);
+  return true;
+}
+
+/**
+ * @brief 取出批处理响应包中的下一条子命令响应
+ * @param responsePkt CMD_BATCH的响应包
+ * @param offset      当前子命令响应在responsePkt->buf中的偏移，返回后指向下一条
+ * @return 子命令响应，已到末尾或数据不完整时返回NULL
+ */
+static pResponseCmdPkt_t nextBatchResponse(pResponseCmdPkt_t responsePkt, uint16_t *offset){
+  uint16_t total = (responsePkt->lenH << 8) | responsePkt->lenL;
+  if(*offset + sizeof(sResponseCmdPkt_t) > total) return NULL;
+  pResponseCmdPkt_t sub = (pResponseCmdPkt_t)&responsePkt->buf[*offset];
+  uint16_t length = (sub->lenH << 8) | sub->lenL;
+  if(*offset + sizeof(sResponseCmdPkt_t) + length > total) return NULL;
+  *offset += sizeof(sResponseCmdPkt_t) + length;
+  return sub;
+}
+
+uint16_t DFRobot_DFR0870_Protocol::appendFile(const char *name, int8_t pid, uint8_t oflag, void *data, uint16_t len){
+  FLASH_DISPATCH(uint16_t, appendFile(name, pid, oflag, data, len));
+  if(_drv == NULL) return 0;
+  if(!isSupported(eFeatureBatch)){
+    int8_t id = 0;
+    if(!openFile(name, pid, oflag, &id, NULL, NULL)) return 0;
+    //数据已经写进文件时同步或关闭失败也返回写入的字节数，调用者据此重试不会重复追加
+    uint16_t total = len ? writeFile(id, data, len) : 0;
+    sync(id);
+    closeFile(id, false);
+    return total;
+  }
+  uint16_t nameLen = strlen(name) + 1;
+  // 子命令：CMD_OPEN_FILE(pid, oflag, name) + CMD_WRITE_FILE(id, data) + CMD_SYNC_FILE(id) + CMD_CLOSE_FILE(id, 0)
+  uint16_t headLen = 1 + SEND_PKT_PRE_FIX_LEN + 2 + nameLen + SEND_PKT_PRE_FIX_LEN + 1;
+  uint8_t  tail[SEND_PKT_PRE_FIX_LEN + 1 + SEND_PKT_PRE_FIX_LEN + 2] = {
+    CMD_SYNC_FILE,  1, 0, BATCH_PREV_ID,
+    CMD_CLOSE_FILE, 2, 0, BATCH_PREV_ID, 0
+  };
+  if((uint32_t)headLen + len + sizeof(tail) > 0xFFFF){
+    CMD_DBG("CMD_BATCH too many bytes.");
+    return 0;
+  }
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(CMD_BATCH, headLen);
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_BATCH packed malloc failed.");
+    return 0;
+  }
+  sendPkt->lenL = (headLen + len + sizeof(tail)) & 0xFF;
+  sendPkt->lenH = ((headLen + len + sizeof(tail)) >> 8) & 0xFF;
+  uint8_t *p = sendPkt->buf;
+  *p++ = 4;
+  *p++ = CMD_OPEN_FILE;
+  *p++ = (2 + nameLen) & 0xFF;
+  *p++ = ((2 + nameLen) >> 8) & 0xFF;
+  *p++ = (uint8_t)pid;
+  *p++ = oflag;
+  memcpy(p, name, nameLen);
+  p += nameLen;
+  *p++ = CMD_WRITE_FILE;
+  *p++ = (len + 1) & 0xFF;
+  *p++ = ((len + 1) >> 8) & 0xFF;
+  *p++ = BATCH_PREV_ID;
+  // 数据段直接从用户缓存发送，不拷贝进命令包
+  bool flag = writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + headLen, false);
+  free(sendPkt);
+  if(flag && len) flag = writeCmdPacket(data, len, false);
+  if(flag) flag = writeCmdPacket(tail, sizeof(tail), true);
+  if(!flag){
+    CMD_DBG("CMD_BATCH send packet fail.");
+    return 0;
+  }
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_BATCH);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_BATCH response packet fail.");
+    return 0;
+  }
+  if(responsePkt->cmd != CMD_BATCH){
+    CMD_DBG("CMD_BATCH response recv packet failrd.");
+    free(responsePkt);
+    return 0;
+  }
+  //模块在第一条失败的子命令处停止，批处理整体失败时也要解析已完成的子命令：
+  //打开成功但没有执行到关闭时要单独关闭，否则模块上的句柄泄漏
+  uint16_t total = 0, offset = 0;
+  uint8_t done = 0;
+  int8_t id = -1;
+  pResponseCmdPkt_t sub;
+  while((done < 4) && ((sub = nextBatchResponse(responsePkt, &offset)) != NULL)){
+    if(sub->state != STATUS_SUCCESS) break;
+    uint16_t subLen = (sub->lenH << 8) | sub->lenL;
+    if((done == 0) && ((sub->cmd != CMD_OPEN_FILE) || (subLen != sCmdDesc<CMD_OPEN_FILE>::responseLen))) break;
+    if(done == 0) id = (int8_t)sub->buf[0];
+    if((sub->cmd == CMD_WRITE_FILE) && (subLen == 2)){
+      total = (sub->buf[1] << 8) | sub->buf[0];
+    }
+    done++;
+  }
+  free(responsePkt);
+  if((id >= 0) && (done < 4)) closeFile(id, false);
+  CMD_DBG(total);
+  return total;
+}
+
+#if FLASH_THREAD_SAFE
+bool DFRobot_DFR0870_Protocol::startDispatcher(uint32_t stack, uint8_t priority){
+  return _dispatcher.start(handleRequests, this, stack, priority);
+}
+
+uint8_t DFRobot_DFR0870_Protocol::handleRequests(void *arg, DFRobot_Dispatcher::sRequest_t *list){
+  DFRobot_DFR0870_Protocol *self = (DFRobot_DFR0870_Protocol *)arg;
+  sRequest_t *req = (sRequest_t *)list;
+  if(req->call){
+    req->call(req->fn);
+    return 1;
+  }
+  return self->writeBatch(req);
+}
+
+uint8_t DFRobot_DFR0870_Protocol::writeBatch(sRequest_t *list){
+  //从list开头取连续的小写请求，合计不超过FLASH_BATCH_SIZE字节
+  uint8_t num = 0;
+  uint16_t len = 1;
+  for(sRequest_t *r = list; r && !r->call && (num < 0xFF); r = (sRequest_t *)r->head.next){
+    if((num > 0) && (len + SEND_PKT_PRE_FIX_LEN + 1 + r->len > FLASH_BATCH_SIZE)) break;
+    len += SEND_PKT_PRE_FIX_LEN + 1 + r->len;
+    num++;
+  }
+  if((num == 1) || !isSupported(eFeatureBatch)){
+    list->ret = writeFileV(list->id, list->iov, list->iovcnt);
+    return 1;
+  }
+  // 子命令：num条CMD_WRITE_FILE(id, data)，数据拷贝进一个命令包，一次发送
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(CMD_BATCH, len);
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_BATCH packed malloc failed.");
+    list->ret = writeFileV(list->id, list->iov, list->iovcnt);
+    return 1;
+  }
+  uint8_t *p = sendPkt->buf;
+  *p++ = num;
+  sRequest_t *r = list;
+  for(uint8_t i = 0; i < num; i++, r = (sRequest_t *)r->head.next){
+    r->ret = 0;
+    *p++ = CMD_WRITE_FILE;
+    *p++ = (r->len + 1) & 0xFF;
+    *p++ = ((r->len + 1) >> 8) & 0xFF;
+    *p++ = (uint8_t)r->id;
+    for(uint8_t k = 0; k < r->iovcnt; k++){
+      memcpy(p, r->iov[k].buf, r->iov[k].len);
+      p += r->iov[k].len;
+    }
+  }
+  bool flag = writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + len);
+  free(sendPkt);
+  if(!flag){
+    CMD_DBG("CMD_BATCH send packet fail.");
+    return num;
+  }
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_BATCH);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_BATCH response packet fail.");
+    return num;
+  }
+  //有子命令失败时模块停止执行后面的子命令，没有执行的请求单独再发一次；
+  //但同一文件前面的写入已经失败的，后面的写入也按失败返回，不能跳过缺失的数据接着写
+  uint16_t offset = 0;
+  uint8_t done = 0;
+  pResponseCmdPkt_t sub;
+  r = list;
+  while((done < num) && ((sub = nextBatchResponse(responsePkt, &offset)) != NULL)){
+    if((sub->state == STATUS_SUCCESS) && (sub->cmd == CMD_WRITE_FILE) && (((sub->lenH << 8) | sub->lenL) == 2)){
+      r->ret = (sub->buf[1] << 8) | sub->buf[0];
+    }
+    r = (sRequest_t *)r->head.next;
+    done++;
+  }
+  free(responsePkt);
+  for(; done < num; done++, r = (sRequest_t *)r->head.next){
+    sRequest_t *q = list;
+    while((q != r) && ((q->id != r->id) || (q->ret == q->len))) q = (sRequest_t *)q->head.next;
+    r->ret = (q == r) ? writeFileV(r->id, r->iov, r->iovcnt) : 0;
+  }
+  return num;
+}
+#endif
+
+uint8_t DFRobot_DFR0870_Protocol::getFileAttributes(int8_t pid, const char *const *names, uint8_t *attrs, uint8_t num){
+  FLASH_DISPATCH(uint8_t, getFileAttributes(pid, names, attrs, num));
+  uint8_t exist = 0;
+  if((names == NULL) || (attrs == NULL) || (num == 0)) return 0;
+  memset(attrs, 0, num);
+  if(!isSupported(eFeatureBatch)){
+    for(uint8_t i = 0; i < num; i++){
+      attrs[i] = getFileAttribute(pid, (char *)names[i]);
+      if(attrs[i]) exist++;
+    }
+    return exist;
+  }
+  uint16_t len = 1;
+  for(uint8_t i = 0; i < num; i++) len += SEND_PKT_PRE_FIX_LEN + 1 + strlen(names[i]) + 1;
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(CMD_BATCH, len);
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_BATCH packed malloc failed.");
+    return 0;
+  }
+  uint8_t *p = sendPkt->buf;
+  *p++ = num;
+  for(uint8_t i = 0; i < num; i++){
+    uint16_t nameLen = strlen(names[i]) + 1;
+    *p++ = CMD_FILE_ATTR;
+    *p++ = (1 + nameLen) & 0xFF;
+    *p++ = ((1 + nameLen) >> 8) & 0xFF;
+    *p++ = (uint8_t)pid;
+    memcpy(p, names[i], nameLen);
+    p += nameLen;
+  }
+  if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + len) == false){
+    CMD_DBG("CMD_BATCH send packet fail.");
+    free(sendPkt);
+    return 0;
+  }
+  free(sendPkt);
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_BATCH);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_BATCH response packet fail.");
+    return 0;
+  }
+  if(responsePkt->cmd != CMD_BATCH){
+    CMD_DBG("CMD_BATCH response recv packet failrd.");
+    free(responsePkt);
+    return 0;
+  }
+  uint16_t offset = 0;
+  pResponseCmdPkt_t sub;
+  // 某条子命令失败时模块停止执行后面的子命令，其后的目录项属性保持为0
+  for(uint8_t i = 0; (i < num) && ((sub = nextBatchResponse(responsePkt, &offset)) != NULL); i++){
+    if((sub->state != STATUS_SUCCESS) || (sub->cmd != CMD_FILE_ATTR) || (((sub->lenH << 8) | sub->lenL) != 1)) break;
+    attrs[i] = sub->buf[0];
+    if(attrs[i]) exist++;
+  }
+  free(responsePkt);
+  return exist;
+}
+
+bool DFRobot_DFR0870_Protocol::newDirectories(const char *path, int8_t pid){
+  FLASH_DISPATCH(bool, newDirectories(path, pid));
+  if(!isSupported(eFeatureMkdirs)){
+    // 从第一级开始逐级检查，某一级被新建后，其下各级必然不存在，无需再查询
+    uint16_t len = strlen(path);
+    char dir[len + 1];
+    bool created = false;
+    for(uint16_t i = 0; i <= len; i++){
+      if((i < len) && (path[i] != '/')) continue;
+      if((i == 0) || (path[i - 1] == '/')) continue;
+      memcpy(dir, path, i);
+      dir[i] = '\0';
+      uint8_t attr = created ? 0 : getFileAttribute(pid, dir);
+      if(attr == 1) return false;
+      if(attr == 0){
+        if(!newDirectory(dir, pid)) return false;
+        created = true;
+      }
+    }
+    return true;
+  }
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_MKDIRS>::cmd, sCmdDesc<CMD_MKDIRS>::sendLen + strlen(path) + 1);
+
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_MKDIRS packed malloc failed.");
+    return false;
+  }
+  sendPkt->buf[0] = (uint8_t)pid;
+  memcpy(&sendPkt->buf[1], path, strlen(path) + 1);
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_MKDIRS send packet fail.");
+    free(sendPkt);
+    return false;
+  }
+  free(sendPkt);
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_MKDIRS);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_MKDIRS response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_MKDIRS) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_MKDIRS>::responseLen)){
+    CMD_DBG("CMD_MKDIRS response recv packet failrd.");
+    free(responsePkt);
+    return false;
+  }
+  free(responsePkt);
+  return true;
+}
+
+bool DFRobot_DFR0870_Protocol::removeTree(int8_t pid, const char *name){
+  FLASH_DISPATCH(bool, removeTree(pid, name));
+  if(!isSupported(eFeatureRmtree)){
+    return removeTreeEntries(pid, name, 1);
+  }
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_RMTREE>::cmd, sCmdDesc<CMD_RMTREE>::sendLen + strlen(name) + 1);
+
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_RMTREE packed malloc failed.");
+    return false;
+  }
+  sendPkt->buf[0] = (uint8_t)pid;
+  memcpy(&sendPkt->buf[1], name, strlen(name) + 1);
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_RMTREE send packet fail.");
+    free(sendPkt);
+    return false;
+  }
+  free(sendPkt);
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_RMTREE);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_RMTREE response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_RMTREE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_RMTREE>::responseLen)){
+    CMD_DBG("CMD_RMTREE response recv packet failrd.");
+    free(responsePkt);
+    return false;
+  }
+  free(responsePkt);
+  return true;
+}
+
+bool DFRobot_DFR0870_Protocol::rename(int8_t pid, const char *from, const char *to){
+  FLASH_DISPATCH(bool, rename(pid, from, to));
+  if(!isSupported(eFeatureRename)){
+    CMD_DBG("CMD_RENAME not supported.");
+    return false;
+  }
+  uint16_t fromLen = strlen(from) + 1;
+  uint16_t toLen = strlen(to) + 1;
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(sCmdDesc<CMD_RENAME>::cmd, sCmdDesc<CMD_RENAME>::sendLen + fromLen + toLen);
+
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_RENAME packed malloc failed.");
+    return false;
+  }
+  sendPkt->buf[0] = (uint8_t)pid;
+  memcpy(&sendPkt->buf[1], from, fromLen);
+  memcpy(&sendPkt->buf[1 + fromLen], to, toLen);
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_RENAME send packet fail.");
+    free(sendPkt);
+    return false;
+  }
+  free(sendPkt);
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_RENAME);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_RENAME response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_RENAME) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_RENAME>::responseLen)){
+    CMD_DBG("CMD_RENAME response recv packet failrd.");
+    free(responsePkt);
+    return false;
+  }
+  free(responsePkt);
+  return true;
+}
+
+bool DFRobot_DFR0870_Protocol::removeTreeEntries(int8_t pid, const char *name, uint8_t depth){
+  uint8_t attr = getFileAttribute(pid, (char *)name);
+  if(attr == 0) return false;
+  if(attr == 1) return remove(pid, (char *)name);
+  if(attr != 5){
+    CMD_DBG("root dir can't be removed.");
+    return false;
+  }
+  if(depth >= DIR_MAX_DEPTH) return false;
+  int8_t id;
+  if(!openDirectory(name, pid, &id)) return false;
+  // 边读边删，读到末尾后回到首项再读一遍，直到目录为空，不依赖模块删除目录项后的读目录位置
+  char child[NAME_MAX_LEN];
+  uint8_t childAttr;
+  bool ret = true, removed;
+  do{
+    removed = false;
+    while(ret && readDirectoryPlus(id, child, sizeof(child), &childAttr, NULL)){
+      if((strcmp(child, ".") == 0) || (strcmp(child, "..") == 0)) continue;
+      if(childAttr == 1) ret = remove(id, child);
+      else ret = removeTreeEntries(id, child, depth + 1);
+      removed = true;
+    }
+    if(ret && removed) ret = rewind(id);
+  }while(ret && removed);
+  closeDirectory(id);
+  return ret && remove(pid, (char *)name);
+}
+
+bool DFRobot_DFR0870_Protocol::readDirectoryPlus(int8_t id, char *name, uint16_t namebufsize, uint8_t *attr, uint32_t *size){
+  FLASH_DISPATCH(bool, readDirectoryPlus(id, name, namebufsize, attr, size));
+  if(!isSupported(eFeatureReadDirPlus)){
+    if(!readDirectory(id, name, namebufsize)) return false;
+    uint8_t type = ((attr != NULL) || (size != NULL)) ? getFileAttribute(id, name) : 0;
+    if(attr) *attr = type;
+    if(size){
+      *size = 0;
+      int8_t fid;
+      if((type == 1) && openFile(name, id, 0x01, &fid, NULL, size)) closeFile(fid, false);
+    }
+    return true;
+  }
+  sCmdPkt<CMD_READ_DIR_PLUS> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
+  sendPkt->buf[0] = (uint8_t)id;
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_READ_DIR_PLUS send packet fail.");
+    return false;
+  }
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_READ_DIR_PLUS);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_READ_DIR_PLUS response packet fail.");
+    return false;
+  }
+  uint16_t length = (responsePkt->lenH << 8) | responsePkt->lenL;
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_READ_DIR_PLUS) || (length <= 5) || ((length - 5) > namebufsize)){
+    CMD_DBG("CMD_READ_DIR_PLUS end of directory or response failed.");
+    free(responsePkt);
+    return false;
+  }
+  if(attr) *attr = responsePkt->buf[0];
+  if(size) *size = (uint32_t)responsePkt->buf[1] | ((uint32_t)responsePkt->buf[2] << 8) | ((uint32_t)responsePkt->buf[3] << 16) | ((uint32_t)responsePkt->buf[4] << 24);
+  memcpy(name, &responsePkt->buf[5], length - 5);
+  name[length - 6] = '\0';
+  CMD_DBG(name);
+  free(responsePkt);
+  return true;
+}
+
+bool DFRobot_DFR0870_Protocol::reserveFile(int8_t id, uint32_t size){
+  FLASH_DISPATCH(bool, reserveFile(id, size));
+  if(!isSupported(eFeatureReserve)){
+    CMD_DBG("CMD_RESERVE not supported.");
+    return false;
+  }
+  sCmdPkt<CMD_RESERVE> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
+  sendPkt->buf[0] = (uint8_t)id;
+  sendPkt->buf[1] = size & 0xFF;
+  sendPkt->buf[2] = (size >> 8) & 0xFF;
+  sendPkt->buf[3] = (size >> 16) & 0xFF;
+  sendPkt->buf[4] = (size >> 24) & 0xFF;
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_RESERVE send packet fail.");
+    return false;
+  }
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_RESERVE);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_RESERVE response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_RESERVE) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_RESERVE>::responseLen)){
+    CMD_DBG("CMD_RESERVE response recv packet failrd.");
+    free(responsePkt);
+    return false;
+  }
+  free(responsePkt);
+  return true;
+}
+
+uint16_t DFRobot_DFR0870_Protocol::preadFile(int8_t id, uint32_t offset, void *data, uint16_t len){
+  sIoVec_t iov = {data, len};
+  return preadFileV(id, offset, &iov, 1);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::preadFileV(int8_t id, uint32_t offset, const sIoVec_t *iov, uint8_t iovcnt){
+  FLASH_DISPATCH(uint16_t, preadFileV(id, offset, iov, iovcnt));
+  if(!isSupported(eFeaturePositionalIO)){
+    CMD_DBG("CMD_PREAD not supported.");
+    return 0;
+  }
+  uint32_t len = 0;
+  for(uint8_t i = 0; i < iovcnt; i++) len += iov[i].len;
+  if(len > 0xFFFF){
+    CMD_DBG("CMD_PREAD too many bytes.");
+    return 0;
+  }
+  sCmdPkt<CMD_PREAD> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
+  sendPkt->buf[0] = (uint8_t)id;
+  sendPkt->buf[1] = offset & 0xFF;
+  sendPkt->buf[2] = (offset >> 8) & 0xFF;
+  sendPkt->buf[3] = (offset >> 16) & 0xFF;
+  sendPkt->buf[4] = (offset >> 24) & 0xFF;
+  sendPkt->buf[5] = len & 0xFF;
+  sendPkt->buf[6] = (len >> 8) & 0xFF;
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_PREAD send packet fail.");
+    return 0;
+  }
+  return recvDataResponse(CMD_PREAD, iov, iovcnt);
+}
+
+uint16_t DFRobot_DFR0870_Protocol::pwriteFile(int8_t id, uint32_t offset, void *data, uint16_t len){
+  FLASH_DISPATCH(uint16_t, pwriteFile(id, offset, data, len));
+  if(!isSupported(eFeaturePositionalIO)){
+    CMD_DBG("CMD_PWRITE not supported.");
+    return 0;
+  }
+  uint8_t param[5] = {(uint8_t)id, (uint8_t)(offset & 0xFF), (uint8_t)((offset >> 8) & 0xFF), (uint8_t)((offset >> 16) & 0xFF), (uint8_t)((offset >> 24) & 0xFF)};
+  sIoVec_t iov = {data, len};
+  if(!writeCmdPacketV(CMD_PWRITE, param, sizeof(param), &iov, 1)) return 0;
+  return recvWriteResponse(CMD_PWRITE);
+}
+
+bool DFRobot_DFR0870_Protocol::crc32File(int8_t id, uint32_t offset, uint32_t len, uint32_t *crc){
+  FLASH_DISPATCH(bool, crc32File(id, offset, len, crc));
+  if(!isSupported(eFeatureCrc32)){
+    CMD_DBG("CMD_CRC32 not supported.");
+    return false;
+  }
+  sCmdPkt<CMD_CRC32> pkt;
+  pSendCmdPkt_t sendPkt = pkt.packed();
+  sendPkt->buf[0] = (uint8_t)id;
+  sendPkt->buf[1] = offset & 0xFF;
+  sendPkt->buf[2] = (offset >> 8) & 0xFF;
+  sendPkt->buf[3] = (offset >> 16) & 0xFF;
+  sendPkt->buf[4] = (offset >> 24) & 0xFF;
+  sendPkt->buf[5] = len & 0xFF;
+  sendPkt->buf[6] = (len >> 8) & 0xFF;
+  sendPkt->buf[7] = (len >> 16) & 0xFF;
+  sendPkt->buf[8] = (len >> 24) & 0xFF;
+  if(writeCmdPacket(sendPkt, (SEND_PKT_PRE_FIX_LEN + ((sendPkt->lenH << 8) | sendPkt->lenL))) == false){
+    CMD_DBG("CMD_CRC32 send packet fail.");
+    return false;
+  }
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_CRC32, CRC32_TIMEOUT_MS);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_CRC32 response packet fail.");
+    return false;
+  }
+  if((responsePkt->state != STATUS_SUCCESS) || (responsePkt->cmd != CMD_CRC32) || (((responsePkt->lenH << 8) | responsePkt->lenL) != sCmdDesc<CMD_CRC32>::responseLen)){
+    CMD_DBG("CMD_CRC32 response recv packet failrd.");
+    free(responsePkt);
+    return false;
+  }
+  if(crc) *crc = (uint32_t)responsePkt->buf[0] | ((uint32_t)responsePkt->buf[1] << 8) | ((uint32_t)responsePkt->buf[2] << 16) | ((uint32_t)responsePkt->buf[3] << 24);
+  free(responsePkt);
+  return true;
+}
+
+uint8_t DFRobot_DFR0870_Protocol::crc32Blocks(int8_t id, uint32_t offset, uint32_t blockSize, uint8_t count, uint32_t *crcs){
+  FLASH_DISPATCH(uint8_t, crc32Blocks(id, offset, blockSize, count, crcs));
+  if((crcs == NULL) || (count == 0)) return 0;
+  if(!isSupported(eFeatureCrc32)){
+    CMD_DBG("CMD_CRC32 not supported.");
+    return 0;
+  }
+  if(!isSupported(eFeatureBatch)){
+    uint8_t i = 0;
+    while((i < count) && crc32File(id, offset + i * blockSize, blockSize, &crcs[i])) i++;
+    return i;
+  }
+  // 子命令：count条CMD_CRC32(id, offset + i * blockSize, blockSize)
+  uint16_t len = 1 + count * (SEND_PKT_PRE_FIX_LEN + 9);
+  pSendCmdPkt_t sendPkt = (pSendCmdPkt_t)packedCmdPacket(CMD_BATCH, len);
+  if(sendPkt == NULL){
+    CMD_DBG("CMD_BATCH packed malloc failed.");
+    return 0;
+  }
+  uint8_t *p = sendPkt->buf;
+  *p++ = count;
+  for(uint8_t i = 0; i < count; i++){
+    uint32_t off = offset + i * blockSize;
+    *p++ = CMD_CRC32;
+    *p++ = 9;
+    *p++ = 0;
+    *p++ = (uint8_t)id;
+    *p++ = off & 0xFF;
+    *p++ = (off >> 8) & 0xFF;
+    *p++ = (off >> 16) & 0xFF;
+    *p++ = (off >> 24) & 0xFF;
+    *p++ = blockSize & 0xFF;
+    *p++ = (blockSize >> 8) & 0xFF;
+    *p++ = (blockSize >> 16) & 0xFF;
+    *p++ = (blockSize >> 24) & 0xFF;
+  }
+  if(writeCmdPacket(sendPkt, SEND_PKT_PRE_FIX_LEN + len) == false){
+    CMD_DBG("CMD_BATCH send packet fail.");
+    free(sendPkt);
+    return 0;
+  }
+  free(sendPkt);
+
+  pResponseCmdPkt_t responsePkt = (pResponseCmdPkt_t)recvCmdResponsePkt(CMD_BATCH, CRC32_TIMEOUT_MS);
+  if(responsePkt == NULL){
+    CMD_DBG("CMD_BATCH response packet fail.");
+    return 0;
+  }
+  if(responsePkt->cmd != CMD_BATCH){
+    CMD_DBG("CMD_BATCH response recv packet failrd.");
+    free(responsePkt);
+    return 0;
+  }
+  // 某条子命令失败时模块停止执行后面的子命令，只返回前面连续成功的块
+  uint16_t off = 0;
+  uint8_t done = 0;
+  pResponseCmdPkt_t sub;
+  while((done < count) && ((sub = nextBatchResponse(responsePkt, &off)) != NULL)){
+    if((sub->state != STATUS_SUCCESS) || (sub->cmd != CMD_CRC32) || (((sub->lenH << 8) | sub->lenL) != 4)) break;
+    crcs[done++] = (uint32_t)sub->buf[0] | ((uint32_t)sub->buf[1] << 8) | ((uint32_t)sub->buf[2] << 16) | ((uint32_t)sub->buf[3] << 24);
+  }
+  free(responsePkt);
+  return done;
+}
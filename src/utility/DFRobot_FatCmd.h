@@ -21,6 +21,16 @@
  * @n CMD_REWIND           回到读目录起始位置
  * @n CMD_ABSPATH          获取当前目录或文件的绝对路径
  * @n CMD_PARENTDIR        获取当前目录或文件的父级目录路径  
+ * @n CMD_VERSION          读取模块协议版本及扩展命令支持情况
+ * @n CMD_BATCH            批处理命令，一个命令包内携带多条子命令，模块依次执行后返回一个合并的响应包
+ * @n CMD_MKDIRS           递归创建目录，相当于mkdir -p
+ * @n CMD_RMTREE           递归移除目录及其下所有文件和子目录，相当于rm -r
+ * @n CMD_READ_DIR_PLUS    读取目录项，同时返回目录项的属性和大小
+ * @n CMD_RESERVE          为文件预分配连续簇，不改变文件的逻辑大小
+ * @n CMD_PREAD            从文件指定位置读数据，不改变文件读写指针
+ * @n CMD_PWRITE           向文件指定位置写数据，不改变文件读写指针
+ * @n CMD_CRC32            计算文件指定范围的CRC-32
+ * @n CMD_RENAME           重命名或移动文件、目录，只修改目录项，不复制数据
  * @copyright	Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
  * @license     The MIT License (MIT)
  * @author [Arya](xue.peng@dfrobot.com)
@@ -38,14 +48,47 @@
 #endif
 #include <Wire.h>
 #include "DFRobot_Driver.h"
+#include "DFRobot_Dispatcher.h"
+
+#if FLASH_THREAD_SAFE
+#ifndef FLASH_COALESCE_SIZE
+#define FLASH_COALESCE_SIZE  64   ///< 不超过此字节数的写请求在排队时可以与其他任务的写请求合并发送，0表示不合并
+#endif
+#ifndef FLASH_BATCH_SIZE
+#define FLASH_BATCH_SIZE     256  ///< 合并后的CMD_BATCH命令包数据的最大字节数
+#endif
+#endif
+
+/**
+ * @struct sIoVec_t
+ * @brief 分散/聚集读写的一段用户缓存
+ */
+typedef struct{
+  void *buf;      /**< 缓存指针 */
+  uint16_t len;   /**< 缓存大小，单位字节 */
+}sIoVec_t;
 
 class DFRobot_DFR0870_Protocol{
 public:
+  /**
+   * @enum eFeature_t
+   * @brief 扩展命令特性位，由CMD_VERSION命令返回，旧版本固件不支持CMD_VERSION，所有特性位均为0
+   */
+  typedef enum{
+    eFeatureBatch = 0x00000001,  /**< 支持CMD_BATCH批处理命令 */
+    eFeatureMkdirs = 0x00000002,  /**< 支持CMD_MKDIRS递归创建目录命令 */
+    eFeatureRmtree = 0x00000004,  /**< 支持CMD_RMTREE递归移除目录命令 */
+    eFeatureReadDirPlus = 0x00000008,  /**< 支持CMD_READ_DIR_PLUS读取目录项及属性命令 */
+    eFeatureReserve = 0x00000010,  /**< 支持CMD_RESERVE文件预分配命令 */
+    eFeaturePositionalIO = 0x00000020,  /**< 支持CMD_PREAD、CMD_PWRITE定位读写命令 */
+    eFeatureCrc32 = 0x00000040,  /**< 支持CMD_CRC32文件校验命令 */
+    eFeatureRename = 0x00000080,  /**< 支持CMD_RENAME重命名命令 */
+  }eFeature_t;
  /**
   * @fn DFRobot_DFR0870_Protocol
   * @brief 空构造函数.
   */
-  DFRobot_DFR0870_Protocol() :_timeoutms(0){}
+  DFRobot_DFR0870_Protocol() :_drv(NULL), _timeoutms(0), _version(0), _features(0){}
  /**
   * @fn begin
   * @brief 协议接口初始化.
@@ -132,6 +175,24 @@ public:
    * @return 实际读取数据大小.
    */
   uint16_t readFile(int8_t id, void *data, uint16_t len);
+  /**
+   * @fn writeFileV
+   * @brief 把多段缓存按顺序写入文件，只发送一个写文件命令，各段数据直接从用户缓存发送，不做中间拷贝
+   * @param id      文件id
+   * @param iov     缓存段数组
+   * @param iovcnt  缓存段个数
+   * @return 实际写入的数据字节，各段总大小超过65534字节时返回0
+   */
+  uint16_t writeFileV(int8_t id, const sIoVec_t *iov, uint8_t iovcnt);
+  /**
+   * @fn readFileV
+   * @brief 只发送一个读文件命令，把读到的数据按顺序依次填入多段缓存
+   * @param id      文件id
+   * @param iov     缓存段数组
+   * @param iovcnt  缓存段个数
+   * @return 实际读取数据大小，各段总大小超过65535字节时返回0
+   */
+  uint16_t readFileV(int8_t id, const sIoVec_t *iov, uint8_t iovcnt);
   /**
    * @fn sync
    * @brief 同步文件内容
@@ -252,16 +313,231 @@ public:
    * @return 此文件或目录的父级目录的绝对路径
    */
   String getParentDirectory(int8_t id, uint8_t type);
+  /**
+   * @fn getAbsolutePath
+   * @brief 获取此文件或目录的绝对路径，直接读入buf，不申请堆内存
+   * @param id   文件或目录id
+   * @param type 文件或目录属性
+   * @param buf  保存路径，以'\0'结尾
+   * @param size buf的大小，路径过长时截断
+   * @return 写入buf的路径长度，失败返回0
+   */
+  uint16_t getAbsolutePath(int8_t id, uint8_t type, char *buf, uint16_t size);
+  /**
+   * @fn getParentDirectory
+   * @brief 获取此文件或目录的父级目录的绝对路径，直接读入buf，不申请堆内存
+   * @param id   文件或目录id
+   * @param type 文件或目录属性
+   * @param buf  保存路径，以'\0'结尾
+   * @param size buf的大小，路径过长时截断
+   * @return 写入buf的路径长度，失败返回0
+   */
+  uint16_t getParentDirectory(int8_t id, uint8_t type, char *buf, uint16_t size);
+  /**
+   * @fn queryVersion
+   * @brief 查询模块协议版本及支持的扩展命令，旧版本固件不支持此命令，此时版本号和特性位均置为0
+   * @return 查询结果
+   * @retval true  查询成功
+   * @retval false 查询失败，模块为旧版本固件
+   */
+  bool queryVersion();
+  /**
+   * @fn version
+   * @brief 获取queryVersion查询到的模块协议版本
+   * @return 协议版本，0表示旧版本固件
+   */
+  uint8_t version(){ return _version; }
+  /**
+   * @fn isSupported
+   * @brief 判断模块是否支持某个扩展命令
+   * @param feature eFeature_t中的特性位
+   * @return 判断结果
+   * @retval true  支持
+   * @retval false 不支持，调用者需回退到单条命令
+   */
+  bool isSupported(uint32_t feature){ return (_features & feature) == feature; }
+  /**
+   * @fn appendFile
+   * @brief 以一次批处理完成 打开-写入-同步-关闭 文件，模块不支持批处理命令时回退为4条单独的命令
+   * @param name    文件名
+   * @param pid     文件父级目录id
+   * @param oflag   打开权限
+   * @param data    指向要写入数据的缓存
+   * @param len     要写入数据的大小，单位字节
+   * @return 实际写入的数据字节，打开或写入失败返回0；写入成功后同步或关闭失败仍返回写入的字节数，数据已追加进文件，不要重试
+   */
+  uint16_t appendFile(const char *name, int8_t pid, uint8_t oflag, void *data, uint16_t len);
+  /**
+   * @fn getFileAttributes
+   * @brief 以一次批处理获取多个文件或目录的属性，模块不支持批处理命令时回退为逐个调用getFileAttribute
+   * @param pid    父级目录id
+   * @param names  目录或文件名数组
+   * @param attrs  保存每个目录或文件的属性，取值同getFileAttribute
+   * @param num    names和attrs的元素个数
+   * @return 存在的文件或目录的个数
+   */
+  uint8_t getFileAttributes(int8_t pid, const char *const *names, uint8_t *attrs, uint8_t num);
+  /**
+   * @fn newDirectories
+   * @brief 递归创建目录，路径中不存在的各级目录都会被创建，模块不支持CMD_MKDIRS时逐级创建
+   * @param path  目录路径，以'/'分隔
+   * @param pid   父级目录id
+   * @return 创建结果
+   * @retval true  创建成功或目录已存在
+   * @retval false 创建失败，或路径中某一级是文件
+   */
+  bool newDirectories(const char *path, int8_t pid);
+  /**
+   * @fn removeTree
+   * @brief 递归移除目录及其下所有内容，也可以移除单个文件，模块不支持CMD_RMTREE时逐项遍历移除
+   * @param pid    父级目录id
+   * @param name   目录或文件名
+   * @return 移除结果
+   * @retval true  移除成功
+   * @retval false 移除失败
+   */
+  bool removeTree(int8_t pid, const char *name);
+  /**
+   * @fn rename
+   * @brief 重命名或移动文件、目录，只修改目录项；to是已存在的文件时原子地替换它，掉电后看到的要么是旧文件要么是新文件
+   * @param pid  父级目录id，from和to都是相对此目录的路径
+   * @param from 原路径
+   * @param to   新路径，所在目录必须已存在，不能是已存在的目录
+   * @return 重命名结果
+   * @retval true  成功
+   * @retval false 失败，或模块不支持CMD_RENAME
+   */
+  bool rename(int8_t pid, const char *from, const char *to);
+  /**
+   * @fn readDirectoryPlus
+   * @brief 读取目录内容，同时获取目录项的属性和大小，模块不支持CMD_READ_DIR_PLUS时额外查询属性和大小
+   * @param id            目录id
+   * @param name          保存读取的文件项名
+   * @param namebufsize   name缓存区大小
+   * @param attr          保存目录项的属性，取值同getFileAttribute，可为NULL
+   * @param size          保存文件大小，目录为0，可为NULL
+   * @return 读取结果
+   * @retval true  读取成功
+   * @retval false 读取失败或已读完
+   */
+  bool readDirectoryPlus(int8_t id, char *name, uint16_t namebufsize, uint8_t *attr, uint32_t *size);
+  /**
+   * @fn reserveFile
+   * @brief 为文件预分配连续簇，之后写入到预分配范围内时模块不再分配簇和更新FAT表
+   * @details 文件的逻辑大小仍为实际写入的长度；正常关闭文件时保留预分配的簇，截断关闭时释放
+   * @param id    文件id
+   * @param size  预分配后文件占用的总字节数
+   * @return 预分配结果
+   * @retval true  预分配成功
+   * @retval false 预分配失败，或模块不支持CMD_RESERVE
+   */
+  bool reserveFile(int8_t id, uint32_t size);
+  /**
+   * @fn preadFile
+   * @brief 从文件的指定位置读数据，不改变文件读写指针
+   * @param id      文件id
+   * @param offset  读取位置，距文件开头的字节数
+   * @param data    保存读取的数据
+   * @param len     读取数据的字节数
+   * @return 实际读取数据大小，模块不支持CMD_PREAD时返回0
+   */
+  uint16_t preadFile(int8_t id, uint32_t offset, void *data, uint16_t len);
+  /**
+   * @fn preadFileV
+   * @brief 从文件的指定位置读数据并依次填入多段缓存，不改变文件读写指针
+   * @param id      文件id
+   * @param offset  读取位置，距文件开头的字节数
+   * @param iov     缓存段数组
+   * @param iovcnt  缓存段个数
+   * @return 实际读取数据大小，模块不支持CMD_PREAD时返回0
+   */
+  uint16_t preadFileV(int8_t id, uint32_t offset, const sIoVec_t *iov, uint8_t iovcnt);
+  /**
+   * @fn pwriteFile
+   * @brief 向文件的指定位置写数据，不改变文件读写指针
+   * @param id      文件id
+   * @param offset  写入位置，距文件开头的字节数
+   * @param data    指向要写入数据的缓存
+   * @param len     要写入数据的大小，单位字节
+   * @return 实际写入的数据字节，模块不支持CMD_PWRITE时返回0
+   */
+  uint16_t pwriteFile(int8_t id, uint32_t offset, void *data, uint16_t len);
+  /**
+   * @fn crc32File
+   * @brief 让模块计算文件指定范围的CRC-32，结果与DFRobot_Crc32相同，不需要把数据读回主控
+   * @param id      文件id
+   * @param offset  起始位置，距文件开头的字节数
+   * @param len     计算的字节数，超过文件末尾时只计算到文件末尾
+   * @param crc     保存计算结果
+   * @return 计算结果
+   * @retval true  成功
+   * @retval false 失败，或模块不支持CMD_CRC32
+   */
+  bool crc32File(int8_t id, uint32_t offset, uint32_t len, uint32_t *crc);
+  /**
+   * @fn crc32Blocks
+   * @brief 让模块计算文件中连续count块的CRC-32，模块支持批处理命令时只需一次总线往返，否则逐块发送CMD_CRC32
+   * @param id        文件id
+   * @param offset    第一块的起始位置
+   * @param blockSize 每块的字节数，最后一块超过文件末尾时只计算到文件末尾
+   * @param count     块数
+   * @param crcs      保存每块的计算结果
+   * @return 从第一块开始连续计算成功的块数，模块不支持CMD_CRC32时返回0
+   */
+  uint8_t crc32Blocks(int8_t id, uint32_t offset, uint32_t blockSize, uint8_t count, uint32_t *crcs);
+#if FLASH_THREAD_SAFE
+  /**
+   * @fn startDispatcher
+   * @brief 启动调度任务，之后各任务的命令都放入队列，由调度任务依次独占通信接口执行，调用者等待自己的命令完成；
+   * @n 排队中的小写请求(不超过FLASH_COALESCE_SIZE字节)会合并成一条CMD_BATCH发送
+   * @param stack    调度任务的栈大小，单位字节
+   * @param priority 调度任务的优先级
+   * @return 启动结果
+   * @retval true  启动成功或已经启动
+   * @retval false 创建任务失败
+   */
+  bool startDispatcher(uint32_t stack = FLASH_DISPATCHER_STACK, uint8_t priority = FLASH_DISPATCHER_PRIORITY);
+#endif
 
 
 protected:
   bool writeCmdPacket(void *pData, uint16_t size,bool endflag = true);
   bool readResponseData(void *pData, uint16_t size, bool endflag = true);
-  void *recvCmdResponsePkt(uint8_t cmd);
+  void *recvCmdResponsePkt(uint8_t cmd, uint32_t timeout = 0);
+  bool recvResponseHead(uint8_t cmd, void *head, uint32_t timeout);
   void *packedCmdPacket(uint8_t cmd, uint16_t len);
+  bool removeTreeEntries(int8_t pid, const char *name, uint8_t depth);
+  bool writeCmdPacketV(uint8_t cmd, const uint8_t *param, uint8_t paramLen, const sIoVec_t *iov, uint8_t iovcnt);
+  uint16_t recvWriteResponse(uint8_t cmd);
+  uint16_t recvDataResponse(uint8_t cmd, const sIoVec_t *iov, uint8_t iovcnt);
+  uint16_t queryPath(uint8_t cmd, int8_t id, uint8_t type, char *buf, uint16_t size);
 
 private:
+  DFRobot_Driver *_drv;  ///< 每个模块对象使用自己的通信接口，多个模块可以同时使用
   uint32_t _timeoutms;
+  uint8_t  _version;   ///< 模块协议版本，0表示不支持CMD_VERSION的旧版本固件
+  uint32_t _features;  ///< 模块支持的扩展命令，见eFeature_t
+#if FLASH_THREAD_SAFE
+  /**
+   * @struct sRequest_t
+   * @brief 交给调度任务的请求：call不为NULL时在调度任务中执行call(fn)；为NULL时是一条可以合并的小写请求
+   */
+  typedef struct{
+    DFRobot_Dispatcher::sRequest_t head;
+    void (*call)(void *fn);
+    void *fn;
+    int8_t id;
+    const sIoVec_t *iov;
+    uint8_t iovcnt;
+    uint16_t len;
+    uint16_t ret;
+  }sRequest_t;
+  template<typename F> static void callRequest(void *fn);
+  template<typename F> void dispatch(F fn);
+  static uint8_t handleRequests(void *arg, DFRobot_Dispatcher::sRequest_t *list);
+  uint8_t writeBatch(sRequest_t *list);
+  DFRobot_Dispatcher _dispatcher;
+#endif
 
 };
 
@@ -20,6 +20,7 @@
 
 #include <Arduino.h>
 #include "DFRobot_Flash.h"
+#include "DFRobot_Crc32.h"
 
 #define STATE_FAILED    0x63
 #define STATE_SUCESS    0x53
@@ -44,7 +45,7 @@
 
 
 DFRobot_Flash::DFRobot_Flash()
-  : _capacity(0),_freeSpace(0),_fatType(0),_fileNums(0){}
+  : _capacity(0),_freeSpace(0),_fatType(0),_fileNums(0),_refreshTime(0),_refreshInterval(0),_walkHandles(0){}
 
 DFRobot_Flash::~DFRobot_Flash(){
 
@@ -61,10 +62,16 @@ uint8_t DFRobot_Flash::init(DFRobot_Driver *drv){
     }
     //delay(2000);//复位后1s内不再接收数据
 
-    if(!_pro.getFlashInfo(&_fatType, &_capacity, &_freeSpace, &_fileNums)){
+    uint32_t freeSec;
+    if(!_pro.getFlashInfo(&_fatType, &_capacity, &freeSec, &_fileNums)){
       FLASH_DBG("get flash info cmd pakage failed! Error: (3 << 4)");
       return (3 << 4);
     }
+    setFreeSectors(freeSec);
+    _refreshTime = millis();
+    if(!_pro.queryVersion()){
+      FLASH_DBG("legacy firmware, extended commands disabled.");
+    }
     FLASH_DBG("init sucess.");
     return 0;
 }
@@ -88,8 +95,43 @@ uint8_t DFRobot_Flash::fatType(){
   return _fatType;
 }
 
+uint32_t DFRobot_Flash::freeSpace(){
+  if(_refreshInterval && (millis() - _refreshTime >= _refreshInterval)){
+    refreshSpace();
+  }
+  return _freeSpace;
+}
+
+uint32_t DFRobot_Flash::usedSpace(){
+  uint32_t freeBytes = freeSpace();
+  return (_capacity > freeBytes) ? (_capacity - freeBytes) : 0;
+}
+
+bool DFRobot_Flash::refreshSpace(){
+  uint32_t freeSec;
+  _refreshTime = millis();
+  if(!_pro.getFlashInfo(NULL, NULL, &freeSec, NULL)){
+    FLASH_DBG("refresh free space failed.");
+    return false;
+  }
+  setFreeSectors(freeSec);
+  return true;
+}
+
+void DFRobot_Flash::setFreeSectors(uint32_t freeSec){
+  //扇区数换算为字节，不超过容量，也避免大容量时溢出
+  if(freeSec >= _capacity / FLASH_SECTOR_SIZE) _freeSpace = _capacity;
+  else _freeSpace = freeSec * FLASH_SECTOR_SIZE;
+}
+
+void DFRobot_Flash::adjustFreeSpace(int32_t delta){
+  if((delta < 0) && ((uint32_t)(-delta) > _freeSpace)) _freeSpace = 0;
+  else if((delta > 0) && (_freeSpace + (uint32_t)delta > _capacity)) _freeSpace = _capacity;
+  else _freeSpace += delta;
+}
+
 DFRobot_FlashFile::DFRobot_FlashFile()
-  :_flash(NULL), _id(INVAILD_ID), _curPosition(0), _size(0), _authority(0), _type(TYPE_FAT_FILE_CLOSED),_fileSizes(0){}
+  :_flash(NULL), _id(INVAILD_ID), _curPosition(0), _size(0), _allocSize(0), _authority(0), _type(TYPE_FAT_FILE_CLOSED),_fileSizes(0){}
 
 DFRobot_FlashFile::~DFRobot_FlashFile(){
 
@@ -139,35 +181,47 @@ bool DFRobot_FlashFile::open(DFRobot_FlashFile* dirFile, const char* fileName, u
         FLASH_DBG("check failed.");
         return false;
       }
-      _type = type;
       if(type != TYPE_FAT_FILE_NORMAL){
         if(!_flash->_pro.openDirectory((char *)fileName, dirFile->_id, &_id)){
           FLASH_DBG("open dir failed!");
           return false;
         }
+        _type = type;
         return true;
       }
     }
+    return openFile(dirFile, fileName, oflag);
+}
+
+bool DFRobot_FlashFile::openFile(DFRobot_FlashFile* dirFile, const char* fileName, uint8_t oflag){
+    if(isOpen() || (dirFile->_flash == NULL)) return false;
+    _flash = dirFile->_flash;
+    _authority = oflag;
     if(!_flash->_pro.openFile((char *)fileName, dirFile->_id, oflag, &_id, &_curPosition, &_size)){
         FLASH_DBG("get open file cmd pakage failed! Error: (3 << 4)");
         return false;
     }
+    _allocSize = _size;
 
     _type = TYPE_FAT_FILE_NORMAL;
     return true;
 }
 
-bool DFRobot_FlashFile::close(bool truncate){//无法关闭根目录
+bool DFRobot_FlashFile::close(bool truncate, bool flush){//无法关闭根目录
     if(!isOpen() || isRoot()) {
       FLASH_DBG("is not open or root dir");
       return false;
     }
 
     if(_type == TYPE_FAT_FILE_NORMAL){
-      _flash->_pro.sync(_id);
+      if(flush) _flash->_pro.sync(_id);
       if(!_flash->_pro.closeFile(_id, truncate)){
         return false;
       } 
+      if(truncate && (_allocSize > _curPosition)){
+        _flash->adjustFreeSpace(_allocSize - _curPosition);
+        _size = _allocSize = _curPosition;
+      }
     }else{
       if(!_flash->_pro.closeDirectory(_id)){
         return false;
@@ -178,15 +232,39 @@ bool DFRobot_FlashFile::close(bool truncate){//无法关闭根目录
     return true;
 }
 
+bool DFRobot_FlashFile::reopen(DFRobot_FlashFile* dirFile, const char* fileName){
+    if(isOpen() || (_flash == NULL) || (dirFile->_flash != _flash)) return false;
+    uint32_t pos = _curPosition;
+    uint32_t alloc = _allocSize;
+    //已知是文件，不用像open那样先查询属性
+    if(!_flash->_pro.openFile((char *)fileName, dirFile->_id, _authority, &_id, &_curPosition, &_size)){
+        FLASH_DBG("reopen file failed!");
+        return false;
+    }
+    _allocSize = alloc > _size ? alloc : _size;
+    _type = TYPE_FAT_FILE_NORMAL;
+    if(_curPosition == pos) return true;
+    return seekSet(pos);
+}
+
 bool DFRobot_FlashFile::isOpen(){
     return _type != TYPE_FAT_FILE_CLOSED;
 }
 
 size_t DFRobot_FlashFile::write(const void* buf, uint16_t nbyte){
+    sIoVec_t iov = {(void *)buf, nbyte};
+    return writev(&iov, 1);
+}
+
+size_t DFRobot_FlashFile::writev(const sIoVec_t* iov, uint8_t iovcnt){
     if(!isFile() || !(_authority & AUTH_O_WRITE)) return 0;
-    uint16_t t = _flash->_pro.writeFile(_id, (void *)buf, nbyte);
+    uint16_t t = _flash->_pro.writeFileV(_id, iov, iovcnt);
      _curPosition += t;
-    _size  = _size > _curPosition ? _size : _curPosition;
+    if(_curPosition > _allocSize){
+      _flash->adjustFreeSpace(-(int32_t)(_curPosition - _allocSize));
+      _allocSize = _curPosition;
+    }
+    _size = _size > _curPosition ? _size : _curPosition;
     return t;
 }
 
@@ -196,12 +274,17 @@ int16_t DFRobot_FlashFile::read(void){
 }
 
 int16_t DFRobot_FlashFile::read(void* buf, uint16_t nbyte){
+    sIoVec_t iov = {buf, nbyte};
+    return (int16_t)readv(&iov, 1);
+}
+
+int32_t DFRobot_FlashFile::readv(const sIoVec_t* iov, uint8_t iovcnt){
     if (!isOpen() || !(_authority & AUTH_O_READ)) return -1;
     //计算一个文件能存储的最大字节数，假如为4
-    uint16_t  t = _flash->_pro.readFile(_id, buf, nbyte);
+    uint16_t  t = _flash->_pro.readFileV(_id, iov, iovcnt);
     _curPosition += t;
     if(t == 0) return -1;
-    return  (int16_t)t;
+    return  (int32_t)t;
 }
 
 uint8_t DFRobot_FlashFile::sync(void){
@@ -222,6 +305,85 @@ uint8_t DFRobot_FlashFile::seekSet(uint32_t pos){
     return true;
 }
 
+int32_t DFRobot_FlashFile::pread(uint32_t offset, void* buf, uint16_t nbyte){
+    sIoVec_t iov = {buf, nbyte};
+    return preadv(offset, &iov, 1);
+}
+
+int32_t DFRobot_FlashFile::preadv(uint32_t offset, const sIoVec_t* iov, uint8_t iovcnt){
+    if(!isFile() || !(_authority & AUTH_O_READ) || (offset > _size)) return -1;
+    uint16_t t = 0;
+    if(_flash->_pro.isSupported(DFRobot_DFR0870_Protocol::eFeaturePositionalIO)){
+      t = _flash->_pro.preadFileV(_id, offset, iov, iovcnt);
+    }else{
+      //模块不支持定位读时，先移到offset读取，再移回原来的读写位置
+      if(!_flash->_pro.seekFile(_id, offset)) return -1;
+      t = _flash->_pro.readFileV(_id, iov, iovcnt);
+      if(!_flash->_pro.seekFile(_id, _curPosition)) return -1;
+    }
+    if(t == 0) return -1;
+    return (int32_t)t;
+}
+
+size_t DFRobot_FlashFile::pwrite(uint32_t offset, const void* buf, uint16_t nbyte){
+    if(!isFile() || !(_authority & AUTH_O_WRITE) || (offset > _size)) return 0;
+    uint16_t t = 0;
+    if(_flash->_pro.isSupported(DFRobot_DFR0870_Protocol::eFeaturePositionalIO)){
+      t = _flash->_pro.pwriteFile(_id, offset, (void *)buf, nbyte);
+    }else{
+      if(!_flash->_pro.seekFile(_id, offset)) return 0;
+      t = _flash->_pro.writeFile(_id, (void *)buf, nbyte);
+      _flash->_pro.seekFile(_id, _curPosition);
+    }
+    uint32_t end = offset + t;
+    if(end > _allocSize){
+      _flash->adjustFreeSpace(-(int32_t)(end - _allocSize));
+      _allocSize = end;
+    }
+    _size = _size > end ? _size : end;
+    return t;
+}
+
+bool DFRobot_FlashFile::crc32(uint32_t offset, uint32_t len, uint32_t *crc){
+    if(!isFile() || !(_authority & AUTH_O_READ) || (offset > _size) || (crc == NULL)) return false;
+    if(len > _size - offset) len = _size - offset;
+    if(_flash->_pro.isSupported(DFRobot_DFR0870_Protocol::eFeatureCrc32)){
+      return _flash->_pro.crc32File(_id, offset, len, crc);
+    }
+    //模块不支持CMD_CRC32时读回数据计算
+    uint8_t buf[64];
+    uint32_t c = 0;
+    while(len){
+      uint16_t n = len > sizeof(buf) ? sizeof(buf) : len;
+      if(pread(offset, buf, n) != n) return false;
+      c = DFRobot_Crc32::update(c, buf, n);
+      offset += n;
+      len -= n;
+    }
+    *crc = c;
+    return true;
+}
+
+uint8_t DFRobot_FlashFile::crc32Blocks(uint32_t offset, uint32_t blockSize, uint8_t count, uint32_t *crcs){
+    if(!isFile() || !(_authority & AUTH_O_READ) || (offset >= _size) || (blockSize == 0) || (crcs == NULL)) return 0;
+    //只计算起点在文件内的块
+    uint32_t blocks = (_size - offset + blockSize - 1) / blockSize;
+    if(count > blocks) count = blocks;
+    //读回数据计算与直接重写的总线流量相同，不支持CMD_CRC32时不计算
+    return _flash->_pro.crc32Blocks(_id, offset, blockSize, count, crcs);
+}
+
+bool DFRobot_FlashFile::reserve(uint32_t nbyte){
+    if(!isFile() || !(_authority & AUTH_O_WRITE)) return false;
+    if(nbyte <= _allocSize) return true;
+    if(!_flash->_pro.reserveFile(_id, nbyte)){
+      return false;
+    }
+    _flash->adjustFreeSpace(-(int32_t)(nbyte - _allocSize));
+    _allocSize = nbyte;
+    return true;
+}
+
 int8_t DFRobot_FlashFile::readDir(char *name,uint16_t size){
   if(!isDir() || (name == NULL)) return -1;
   if(_flash->_pro.readDirectory(_id, name, size)) return 0;
@@ -250,7 +412,10 @@ void DFRobot_FlashFile::rewind(void){
 }
 
 uint8_t DFRobot_FlashFile::remove(const char* fileName){
-  return _flash->_pro.remove(_id, (char *)fileName);
+  uint8_t ret = _flash->_pro.remove(_id, (char *)fileName);
+  //移除释放的空间大小未知(含簇对齐)，重新查询一次，循环日志删除旧文件后能立即看到空间增加
+  if(ret) _flash->refreshSpace();
+  return ret;
 }
 
 bool DFRobot_FlashFile::exists(const char* fileName){
@@ -264,6 +429,96 @@ String DFRobot_FlashFile::absolutePath(){
 String DFRobot_FlashFile::parentDirectory(){
   return _flash->_pro.getParentDirectory(_id, _type);
 }
+uint16_t DFRobot_FlashFile::absolutePath(char *buf, uint16_t size){
+  return _flash->_pro.getAbsolutePath(_id, _type, buf, size);
+}
+uint16_t DFRobot_FlashFile::parentDirectory(char *buf, uint16_t size){
+  return _flash->_pro.getParentDirectory(_id, _type, buf, size);
+}
+
+uint16_t DFRobot_FlashFile::append(const char* fileName, const void* buf, uint16_t nbyte, uint8_t oflag){
+  if(!isDir() || (fileName == NULL)) return 0;
+  uint16_t t = _flash->_pro.appendFile(fileName, _id, oflag, (void *)buf, nbyte);
+  _flash->adjustFreeSpace(-(int32_t)t);
+  return t;
+}
+
+uint8_t DFRobot_FlashFile::getAttributes(const char* const* fileNames, uint8_t* attrs, uint8_t num){
+  if(!isDir()) return 0;
+  return _flash->_pro.getFileAttributes(_id, fileNames, attrs, num);
+}
+
+bool DFRobot_FlashFile::makeDirs(const char* dirPath){
+  if(!isDir() || (dirPath == NULL)) return false;
+  return _flash->_pro.newDirectories(dirPath, _id);
+}
+
+bool DFRobot_FlashFile::removeTree(const char* fileName){
+  if(!isDir() || (fileName == NULL)) return false;
+  bool ret = _flash->_pro.removeTree(_id, fileName);
+  //部分移除失败时也可能已释放空间
+  _flash->refreshSpace();
+  return ret;
+}
+
+bool DFRobot_FlashFile::rename(const char* from, const char* to){
+  if(!isDir() || (from == NULL) || (to == NULL)) return false;
+  return _flash->_pro.rename(_id, from, to);
+}
+
+bool DFRobot_FlashFile::walk(const char* dirName, DFRobot_FlashWalkCallback cb, void *arg){
+  if(!isDir() || (cb == NULL)) return false;
+  char path[FLASH_PATH_MAX];
+  uint16_t len = 0;
+  int8_t id;
+  if((dirName == NULL) || (dirName[0] == '\0') || (strcmp(dirName, "/") == 0)){
+    path[0] = '\0';
+    if(!isRoot()){
+      _flash->_pro.rewind(_id);
+      return walkEntries(_id, path, 0, 1, cb, arg);
+    }
+    //根目录句柄由模块共用，另开一个句柄遍历，不改变其读目录位置
+    if(!_flash->_pro.openDirectory((char *)"/", -1, &id)) return false;
+  }else{
+    len = strlen(dirName);
+    while(len && (dirName[len - 1] == '/')) len--;
+    if(len >= sizeof(path)) return false;
+    memcpy(path, dirName, len);
+    path[len] = '\0';
+    if(_flash->_pro.getFileAttribute(_id, path) != TYPE_FAT_FILE_SUBDIR) return false;
+    if(!_flash->_pro.openDirectory(path, _id, &id)) return false;
+  }
+  _flash->_walkHandles++;
+  bool ret = walkEntries(id, path, len, 1, cb, arg);
+  _flash->_pro.closeDirectory(id);
+  _flash->_walkHandles--;
+  return ret;
+}
+
+bool DFRobot_FlashFile::walkEntries(int8_t id, char *path, uint16_t len, uint8_t depth, DFRobot_FlashWalkCallback cb, void *arg){
+  char name[13];
+  uint8_t attr;
+  uint32_t size;
+  while(_flash->_pro.readDirectoryPlus(id, name, sizeof(name), &attr, &size)){
+    if((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0)) continue;
+    uint16_t nameLen = strlen(name);
+    if(len + 1 + nameLen >= FLASH_PATH_MAX) return false;
+    path[len] = '/';
+    memcpy(&path[len + 1], name, nameLen + 1);
+    if(!cb(path, attr, size, depth, arg)) return false;
+    if(attr == TYPE_FAT_FILE_SUBDIR){
+      int8_t subId;
+      if(!_flash->_pro.openDirectory(name, id, &subId)) return false;
+      _flash->_walkHandles++;
+      bool ret = walkEntries(subId, path, len + 1 + nameLen, depth + 1, cb, arg);
+      _flash->_pro.closeDirectory(subId);
+      _flash->_walkHandles--;
+      if(!ret) return false;
+    }
+    path[len] = '\0';
+  }
+  return true;
+}
 
 
 /*
@@ -23,6 +23,10 @@
 #include "DFRobot_FatCmd.h"
 #include "DFRobot_Driver.h"
 
+#ifndef FLASH_SECTOR_SIZE
+#define FLASH_SECTOR_SIZE  512  ///< 扇区大小，单位字节，CMD_FLASH_INFO返回的空闲空间以扇区为单位
+#endif
+
 ///< Define DBG, change 0 to 1 open the DBG, 1 to 0 to close.  
 class DFRobot_Flash{
 public:
@@ -79,19 +83,78 @@ public:
    * @return 模块的I2C地址.
    */
   uint8_t getI2CAddress();
+  /**
+   * @fn freeSpace
+   * @brief 获取磁盘空闲空间，单位字节
+   * @details 返回值由上次CMD_FLASH_INFO查询结果加上此后写入、截断的字节数估算，不会访问模块，
+   * @n 设置了刷新间隔且已超时时才重新查询。移除文件、目录成功后会立即重新查询，释放的空间马上计入
+   * @return 空闲空间
+   */
+  uint32_t freeSpace();
+  /**
+   * @fn usedSpace
+   * @brief 获取磁盘已用空间，单位字节，估算方式同freeSpace
+   * @return 已用空间
+   */
+  uint32_t usedSpace();
+  /**
+   * @fn refreshSpace
+   * @brief 立即发送CMD_FLASH_INFO命令，重新获取磁盘空闲空间
+   * @return 刷新结果
+   * @retval true  刷新成功
+   * @retval false 刷新失败，保留原估算值
+   */
+  bool refreshSpace();
+  /**
+   * @fn setSpaceRefreshInterval
+   * @brief 设置freeSpace自动刷新的间隔
+   * @param ms 刷新间隔，单位毫秒，0表示从不自动刷新，默认为0
+   */
+  void setSpaceRefreshInterval(uint32_t ms){ _refreshInterval = ms; }
+  /**
+   * @fn walkHandles
+   * @brief 获取walk遍历过程中占用的目录句柄数，上层分配句柄时需要一并计入
+   * @return 正在使用的遍历目录句柄数
+   */
+  uint8_t walkHandles(){ return _walkHandles; }
+#if FLASH_THREAD_SAFE
+  /**
+   * @fn startDispatcher
+   * @brief 启动调度任务，之后多个任务可以同时操作此模块上的文件，见DFRobot_DFR0870_Protocol::startDispatcher
+   */
+  bool startDispatcher(uint32_t stack = FLASH_DISPATCHER_STACK, uint8_t priority = FLASH_DISPATCHER_PRIORITY){ return _pro.startDispatcher(stack, priority); }
+#endif
 
   DFRobot_DFR0870_Protocol _pro;
 
 private:
   friend class DFRobot_FlashFile; //Allow DFRobot_FlashFile access to DFRobot_Flash private data.
+  void adjustFreeSpace(int32_t delta);
+  void setFreeSectors(uint32_t freeSec);
   
   uint32_t _capacity; ///< flash 容量， 单位字节
   uint32_t _freeSpace; ///< 空闲空间， 单位字节
   uint8_t _fatType; ///< fat文件系统类型， 0：FAT2  1：FAT16  2: FAT32
   uint16_t _fileNums; ///< 能够存储的最大的文件数
+  uint32_t _refreshTime; ///< 上次获取空闲空间的时间，单位毫秒
+  uint32_t _refreshInterval; ///< 空闲空间自动刷新间隔，单位毫秒，0表示不自动刷新
+  uint8_t _walkHandles; ///< walk遍历中打开的目录句柄数
 };
 
 
+#define FLASH_PATH_MAX  131  ///< 路径最大长度，最多10级目录，每级最多12字节加'/'
+
+/**
+ * @brief 目录遍历回调函数
+ * @param path  目录项的路径
+ * @param attr  目录项属性，1：文件 5：子目录
+ * @param size  文件大小，目录为0
+ * @param depth 目录项相对遍历起点的层级，起点下的直接子项为1
+ * @param arg   调用walk时传入的用户参数
+ * @return 返回false停止遍历
+ */
+typedef bool (*DFRobot_FlashWalkCallback)(const char *path, uint8_t attr, uint32_t size, uint8_t depth, void *arg);
+
 class DFRobot_FlashFile{
 public:
  /**
@@ -126,6 +189,17 @@ public:
    */
   bool open(DFRobot_FlashFile& dirFile, const char* fileName, uint8_t oflag) {return open(&dirFile, fileName, oflag);}
   bool open(DFRobot_FlashFile* dirFile, const char* fileName, uint8_t oflag);
+  /**
+   * @fn openFile
+   * @brief 打开已知是普通文件的路径，不像open那样以只读方式打开时先查询属性，少一条命令
+   * @param dirFile  父级目录
+   * @param fileName 文件名或路径
+   * @param oflag    打开权限
+   * @return 返回打开结果
+   * @retval true  打开成功
+   * @retval false 打开失败，路径是目录时也会失败
+   */
+  bool openFile(DFRobot_FlashFile* dirFile, const char* fileName, uint8_t oflag);
   /**
    * @fn isOpen
    * @brief 判断文件或目录是否打开
@@ -137,11 +211,29 @@ public:
   /**
    * @fn close
    * @brief 关闭文件或目录，注意，根目录一经打开，则不会再关闭
+   * @param truncate 是否截断读写指针之后的内容
+   * @param flush    关闭文件前是否同步，已经同步过且之后没有写入时可以省去一次命令
    * @return 返回关闭结果
    * @retval true  文件或目录关闭成功
    * @retval false 文件或目录关闭失败
    */
-  bool close(bool truncate);
+  bool close(bool truncate, bool flush = true);
+  /**
+   * @fn reopen
+   * @brief 重新打开被close(false)关闭的文件，沿用原来的打开权限，并把读写指针恢复到关闭时的位置
+   * @param dirFile  文件名相对的目录
+   * @param fileName 文件名或路径
+   * @return 返回打开结果
+   * @retval true  重新打开成功
+   * @retval false 文件已打开、从未打开过或打开失败
+   */
+  bool reopen(DFRobot_FlashFile* dirFile, const char* fileName);
+  /**
+   * @fn authority
+   * @brief 获取打开文件时的权限
+   * @return 打开权限，如FILE_READ、FILE_WRITE
+   */
+  uint8_t authority(void){ return _authority; }
   /**
    * @fn write
    * @brief 向文件中写数据
@@ -164,6 +256,68 @@ public:
    * @return 返回实际读取数据的大小
    */
   int16_t read(void* buf, uint16_t nbyte);
+  /**
+   * @fn writev
+   * @brief 把多段缓存按顺序写入文件，只需一次写文件命令
+   * @param iov    缓存段数组
+   * @param iovcnt 缓存段个数
+   * @return 返回实际写入数据的大小
+   */
+  size_t writev(const sIoVec_t* iov, uint8_t iovcnt);
+  /**
+   * @fn readv
+   * @brief 从文件中读取数据并依次填入多段缓存，只需一次读文件命令
+   * @param iov    缓存段数组
+   * @param iovcnt 缓存段个数
+   * @return 返回实际读取数据的大小，失败返回-1
+   */
+  int32_t readv(const sIoVec_t* iov, uint8_t iovcnt);
+  /**
+   * @fn pread
+   * @brief 从文件的指定位置读取数据，不改变文件的读写位置curPosition
+   * @param offset 读取位置，不能超过文件大小
+   * @param buf    保存读取的数据
+   * @param nbyte  要读取的字节数
+   * @return 返回实际读取数据的大小，失败返回-1
+   */
+  int32_t pread(uint32_t offset, void* buf, uint16_t nbyte);
+  /**
+   * @fn preadv
+   * @brief 从文件的指定位置读取数据并依次填入多段缓存，不改变文件的读写位置curPosition
+   * @param offset 读取位置，不能超过文件大小
+   * @param iov    缓存段数组
+   * @param iovcnt 缓存段个数
+   * @return 返回实际读取数据的大小，失败返回-1
+   */
+  int32_t preadv(uint32_t offset, const sIoVec_t* iov, uint8_t iovcnt);
+  /**
+   * @fn pwrite
+   * @brief 向文件的指定位置写入数据，不改变文件的读写位置curPosition
+   * @param offset 写入位置，不能超过文件大小，等于文件大小时为追加
+   * @param buf    要写入的数据
+   * @param nbyte  要写入的字节数
+   * @return 返回实际写入数据的大小
+   */
+  size_t pwrite(uint32_t offset, const void* buf, uint16_t nbyte);
+  /**
+   * @fn crc32
+   * @brief 计算文件指定范围的CRC-32，模块支持CMD_CRC32时由模块计算，否则读回数据在主控上计算
+   * @param offset 起始位置
+   * @param len    计算的字节数，超过文件末尾时只计算到文件末尾
+   * @param crc    保存计算结果
+   * @return 计算结果
+   */
+  bool crc32(uint32_t offset, uint32_t len, uint32_t *crc);
+  /**
+   * @fn crc32Blocks
+   * @brief 计算从offset开始连续count块的CRC-32，模块支持CMD_CRC32和批处理命令时只需一次总线往返
+   * @param offset    第一块的起始位置
+   * @param blockSize 每块的字节数，最后一块超过文件末尾时只计算到文件末尾
+   * @param count     块数，超出文件末尾的块不计算
+   * @param crcs      保存每块的计算结果
+   * @return 计算成功的块数，模块不支持CMD_CRC32时返回0
+   */
+  uint8_t crc32Blocks(uint32_t offset, uint32_t blockSize, uint8_t count, uint32_t *crcs);
   /**
    * @fn sync
    * @brief 同步文件内容
@@ -203,6 +357,15 @@ public:
    * @retval 1  设置成功
    */
   uint8_t seekSet(uint32_t pos);
+  /**
+   * @fn reserve
+   * @brief 为文件预分配连续空间，文件大小fileSize不变，写入预分配范围内时没有分配簇的延时
+   * @param nbyte 预分配后文件占用的总字节数，小于等于已占用的大小时直接返回成功
+   * @return 预分配结果
+   * @retval true  预分配成功
+   * @retval false 预分配失败，或模块不支持
+   */
+  bool reserve(uint32_t nbyte);
   /**
    * @fn isFile
    * @brief 判断是否为文件
@@ -280,12 +443,91 @@ public:
    * @return 此文件或目录的父级目录路径
    */
   String parentDirectory();
+  /**
+   * @fn absolutePath
+   * @brief 获取文件或目录的绝对路径，不申请堆内存
+   * @param buf  保存路径
+   * @param size buf的大小
+   * @return 路径长度，失败返回0
+   */
+  uint16_t absolutePath(char *buf, uint16_t size);
+  /**
+   * @fn parentDirectory
+   * @brief 获取父级目录的绝对路径，不申请堆内存
+   * @param buf  保存路径
+   * @param size buf的大小
+   * @return 路径长度，失败返回0
+   */
+  uint16_t parentDirectory(char *buf, uint16_t size);
+  /**
+   * @fn append
+   * @brief 打开此目录下的文件，写入数据，同步并关闭，模块支持时只需一次批处理命令
+   * @param fileName 文件名
+   * @param buf      指向要写入数据的缓存指针
+   * @param nbyte    写入数据的大小，单位字节
+   * @param oflag    打开权限
+   * @return 返回实际写入数据的大小，失败返回0；数据写入后同步或关闭失败仍返回写入的大小
+   */
+  uint16_t append(const char* fileName, const void* buf, uint16_t nbyte, uint8_t oflag);
+  /**
+   * @fn getAttributes
+   * @brief 获取此目录下多个文件或目录的属性，模块支持时只需一次批处理命令
+   * @param fileNames 目录或文件名数组
+   * @param attrs     保存每个目录或文件的属性，0表示不存在
+   * @param num       fileNames和attrs的元素个数
+   * @return 存在的文件或目录的个数
+   */
+  uint8_t getAttributes(const char* const* fileNames, uint8_t* attrs, uint8_t num);
+  /**
+   * @fn makeDirs
+   * @brief 递归创建目录，路径中不存在的各级目录都会被创建
+   * @param dirPath 目录相对路径
+   * @return 创建结果
+   * @retval false  创建失败
+   * @retval true   创建成功或已存在
+   */
+  bool makeDirs(const char* dirPath);
+  /**
+   * @fn removeTree
+   * @brief 递归移除目录及其下的所有文件和子目录，也可以移除单个文件
+   * @param fileName 目录或文件名
+   * @return 移除结果
+   * @retval false  移除失败
+   * @retval true   移除成功
+   */
+  bool removeTree(const char* fileName);
+  /**
+   * @fn rename
+   * @brief 重命名或移动文件、目录，新路径是已存在的文件时原子地替换它
+   * @param from 原路径
+   * @param to   新路径
+   * @return 重命名结果
+   * @retval false  失败或模块不支持CMD_RENAME
+   * @retval true   成功
+   */
+  bool rename(const char* from, const char* to);
+  /**
+   * @fn walk
+   * @brief 深度优先遍历目录，先访问目录本身再访问其下的目录项
+   * @details 每一层目录占用一个模块句柄，遍历根目录时另开句柄，不影响根目录的读目录位置，
+   * @n 占用的句柄数可由DFRobot_Flash::walkHandles获取
+   * @param dirName 要遍历的目录名，NULL、""或"/"表示此目录本身
+   * @param cb      每个目录项调用一次的回调函数
+   * @param arg     传给回调函数的用户参数
+   * @return 遍历结果
+   * @retval false  遍历失败或被回调函数停止
+   * @retval true   遍历完成
+   */
+  bool walk(const char* dirName, DFRobot_FlashWalkCallback cb, void *arg);
 
 private:
+  bool walkEntries(int8_t id, char *path, uint16_t len, uint8_t depth, DFRobot_FlashWalkCallback cb, void *arg);
+
   DFRobot_Flash *_flash;
   int8_t _id;
   uint32_t _curPosition;
   uint32_t _size;
+  uint32_t _allocSize; ///< 文件实际占用的字节数，预分配后可能大于_size
   uint8_t _authority; ///< 打开权限
   uint8_t _type;
   uint8_t _fileSizes;